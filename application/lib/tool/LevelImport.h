@@ -9,6 +9,7 @@
 
 #include "FullInit.h"
 #include "../SimpleModel.h" // need the ModelInfo structure type
+#include "../../../map_format.h"
 
 auto ImportLevelFile(std::string filename, GameWorld& gw, bool gen_uv = false) -> std::pair<ModelInfo, ModelInfo>;
 
@@ -16,27 +17,11 @@ auto ImportLevelFile(std::string filename, GameWorld& gw, bool gen_uv = false) -
 // implementation
 // ==================================================================
 auto ImportLevelFile(std::string filename, GameWorld& gw, bool gen_uv) -> std::pair<ModelInfo, ModelInfo> {
-    std::ifstream is(filename);
-    std::string token;
-
-    if(!(is >> token)) {
-        std::cout << "ImportLevelFile : invalid file format\n" << std::flush;
-        exit(1);
-    }
-
     std::vector<GLfloat> verts;
     std::vector<GLfloat> uv;
-    //std::array<int, 625> raw;
-
-    // need to get past the actual tile data
-    for(int i = 0; i < 25*25; i++) {
-        int t;
-        //is >> raw[i];
-        is >> t;
-    }
 
-    //                                                    z-len    x-len
-    auto gl_gen_box = [&gen_uv](float xstart, float zstart, float l, float w) -> std::pair<std::vector<float>, std::vector<float>> {
+    //                                                    z-len    x-len    first layer  layers
+    auto gl_gen_box = [&gen_uv](float xstart, float zstart, float l, float w, float ybase, float d) -> std::pair<std::vector<float>, std::vector<float>> {
         std::vector<float> verts;
         std::vector<float> uv;
 
@@ -65,12 +50,15 @@ auto ImportLevelFile(std::string filename, GameWorld& gw, bool gen_uv) -> std::p
         xstart += (w / 2.0f);
         zstart += (l / 2.0f);
 
+        // layer 0 spans y = -0.5 .. 0.5, every layer above adds one unit
+        const float ycenter = ybase - 0.5f + (d / 2.0f);
+
         for(auto& a : lut) {
             for(int idx : a) {
                 auto tp = tips[idx];
 
                 verts.push_back(xstart + ( tp[0] * w ));
-                verts.push_back(tp[1]);
+                verts.push_back(ycenter + ( tp[1] * d ));
                 verts.push_back(zstart + ( tp[2] * l ));
 
             }
@@ -82,21 +70,21 @@ auto ImportLevelFile(std::string filename, GameWorld& gw, bool gen_uv) -> std::p
                 uv.insert(uv.end(), { 
                     0.0f, 0.0f, 
                     l,    0.0f, 
-                    l,    1.0f, 
+                    l,    d, 
                     
                     0.0f, 0.0f,
-                    l,    1.0f,
-                    0.0f, 1.0f,
+                    l,    d,
+                    0.0f, d,
                     
 
 
                     0.0f, 0.0f, 
                     w,    0.0f, 
-                    w,    1.0f, 
+                    w,    d, 
                     
                     0.0f, 0.0f,
-                    w,    1.0f,
-                    0.0f, 1.0f  });
+                    w,    d,
+                    0.0f, d  });
             }
 
             const float scale = 2.0f;
@@ -107,18 +95,13 @@ auto ImportLevelFile(std::string filename, GameWorld& gw, bool gen_uv) -> std::p
         return { verts, uv };
     };
 
-    // actual collision entity data
-    int collids;
-    is >> collids;
-
-    for(int i = 0; i < collids; i++) {
-        float x, y, h, w;        
-        is >> x >> y >> h >> w;
-
+    // one wall box and one static rigid body per collision box, however
+    // many layers (z .. z+d) it covers
+    auto add_wall = [&](float x, float y, float h, float w, float z, float d) {
         x -= 0.5f;
         y -= 0.5f;
 
-        auto newbox = gl_gen_box(x, y, h, w);
+        auto newbox = gl_gen_box(x, y, h, w, z, d);
         verts.insert(verts.end(), newbox.first.begin(), newbox.first.end());
 
         if(gen_uv)
@@ -129,13 +112,13 @@ auto ImportLevelFile(std::string filename, GameWorld& gw, bool gen_uv) -> std::p
         y += ( h / 2.0f );
 
         // provide half-extents
-        btCollisionShape* ground_shape = new btBoxShape(btVector3(w/2.0, 0.5, h/2.0));
+        btCollisionShape* ground_shape = new btBoxShape(btVector3(w/2.0, d/2.0, h/2.0));
         gw.collision_shapes.push_back(ground_shape);
 
         // specify where the ground is in world coordinates
         btTransform ground_tf;
         ground_tf.setIdentity();
-        ground_tf.setOrigin(btVector3( x, 0.0, y ));
+        ground_tf.setOrigin(btVector3( x, z - 0.5 + d/2.0, y ));
 
         btScalar  m(0.0);
         btVector3 local_inertia(0.0, 0.0, 0.0);
@@ -145,10 +128,52 @@ auto ImportLevelFile(std::string filename, GameWorld& gw, bool gen_uv) -> std::p
         body->setFriction(1.0);
 
         gw.dynamicsWorld->addRigidBody(body);
+    };
 
+    MappedLevel ml;
+    if(ml.open(filename)) {
+        // pre-baked collision table, read straight out of the mapping
+        for(int i = 0; i < ml.boxCount(); i++) {
+            LevelFileBox b = ml.box(i);
+            add_wall(b.x, b.y, b.h, b.w, b.z, b.d);
+        }
     }
+    else {
+        TextMapReader rd;
 
-    is.close();
+        int width, height, layers;
+        if(!rd.open(filename) || !rd.readHeader(width, height, layers)) {
+            std::cout << "ImportLevelFile : " << filename << ": " << rd.error() << "\n" << std::flush;
+            exit(1);
+        }
+
+        // need to get past the actual tile data
+        for(long i = 0; i < long(width) * height * layers; i++) {
+            int t;
+            if(!rd.readTile(t)) {
+                std::cout << "ImportLevelFile : " << filename << ": " << rd.error() << "\n" << std::flush;
+                exit(1);
+            }
+        }
+
+        // actual collision entity data
+        long collids;
+        if(!rd.readInt(collids)) {
+            std::cout << "ImportLevelFile : " << filename << ": " << rd.error() << "\n" << std::flush;
+            exit(1);
+        }
+
+        // single layer maps only store 'x y h w', everything sits on layer 0
+        for(long i = 0; i < collids; i++) {
+            long x, y, h, w, z = 0, d = 1;
+            if(!rd.readInt(x) || !rd.readInt(y) || !rd.readInt(h) || !rd.readInt(w) ||
+                    (layers > 1 && (!rd.readInt(z) || !rd.readInt(d)))) {
+                std::cout << "ImportLevelFile : " << filename << ": " << rd.error() << "\n" << std::flush;
+                exit(1);
+            }
+            add_wall(x, y, h, w, z, d);
+        }
+    }
 
     // place all of these vertices in the world
     ModelInfo mi_verts, mi_uv;
@@ -7,158 +7,282 @@
 #include <iostream>
 #include <string>
 #include <fstream>
+#include <algorithm>
+
+#include "../map_format.h"
+#include "../nav_graph.h"
+#include "../path_search.h"
+#include "../nav_hierarchy.h"
+#include "../path_cache.h"
+#include "../nav_components.h"
+#include "../distance_table.h"
+#include "../path_smooth.h"
+
+// walkable tiles of a level plus its ai spawn points. nodes live in a
+// dense NavGrid so building and searching are flat array walks
+struct Graph {
+private:
+    std::vector<std::pair<int,int>> ai_spawn_points;
+    NavGrid grid;
 
-struct GraphNode {
-
-    int flags;
-
-    std::pair<int, int> up;
-    std::pair<int, int> down;
-    std::pair<int, int> left;
-    std::pair<int, int> right;
-
-    // init everything to -1 (an invalid index into the node_map)
-    GraphNode(void) : up(-1, -1), down(-1,-1), left(-1, -1), right(-1, -1) {}
-
-    void resetFlags(void) { 
-        this->flags = 0x00; }
-
-    bool visited(void) { 
-        return flags & 0x01; }
+    // search scratch, reused by every search on this graph
+    PathSearch search;
+    std::vector<int> cells;
+    std::vector<int> waypoint_cells;
 
-    void visit() {
-        this->flags |= 0x01; }
+    // clusters for PathMode::HPA, built by the first such query and
+    // patched as nodes get added after that
+    NavHierarchy hierarchy;
+    bool hierarchy_built;
 
-    bool hasNorth(void) { return this->up    != std::pair<int,int>{ -1, -1 }; }
-    bool hasSouth(void) { return this->down  != std::pair<int,int>{ -1, -1 }; }
-    bool hasEast(void)  { return this->right != std::pair<int,int>{ -1, -1 }; }
-    bool hasWest(void)  { return this->left  != std::pair<int,int>{ -1, -1 }; }
+    // recent findPath answers. version goes up whenever a node is added
+    // so nothing found on an older map is ever handed out
+    PathCache cache;
+    unsigned long version;
 
-};
+    // connected regions, a query between two of them fails right away
+    // instead of searching everything reachable from the start
+    NavComponents components;
 
-struct Graph {
-private:
-    std::vector<std::pair<int,int>> ai_spawn_points;
-    std::map<std::pair<int, int>, GraphNode> node_map;
+    // every pairwise distance, only there after loadDistances and
+    // dropped again as soon as a node is added
+    DistanceTable distances;
 
 public:
 
-    void insertNewNode(int y, int x) {
-        auto iter = this->node_map.find({ y, x });
-
-        if(iter == this->node_map.end()) {
-            this->node_map.insert({{ y, x }, GraphNode()});
-
-            // update neighbors
-            {
-                // search left
-                auto niter = this->node_map.find({ y, x-1 });
-                if(niter != this->node_map.end()) {
-                    this->node_map[std::pair<int,int>{ y, x-1 }].right = {y,x};
-                    this->node_map[std::pair<int,int>{ y, x }].left = { y, x-1 };
-                }
+    Graph(int width = LEVEL_DEFAULT_WIDTH, int height = LEVEL_DEFAULT_HEIGHT) :
+        grid(width, height), hierarchy_built(false), version(0) {
+        this->components.build(this->grid); }
 
-                // search right
-                niter = this->node_map.find({ y, x+1 });
-                if(niter != this->node_map.end()) {
-                    this->node_map[std::pair<int,int>{ y, x+1 }].left = { y, x };
-                    this->node_map[std::pair<int,int>{ y, x }].right = { y, x+1 };
-                }
+    const NavGrid& getGrid(void) const { return this->grid; }
+    const PathCache& getPathCache(void) const { return this->cache; }
+    unsigned long getVersion(void) const { return this->version; }
 
-                // search up
-                niter = this->node_map.find({ y-1, x });
-                if(niter != this->node_map.end()) {
-                    this->node_map[std::pair<int,int>{ y-1, x }].down = { y, x };
-                    this->node_map[std::pair<int,int>{ y, x }].up = { y-1, x };
-                }
+    // tiles outside the map are ignored
+    void insertNewNode(int y, int x) {
+        if(!this->grid.inBounds(y, x) || this->grid.walkable(y, x))
+            return;
+
+        this->grid.insertNode(y, x);
+        this->components.tileChanged(this->grid, y, x);
+        this->distances.clear();
+        this->version++;
+        if(this->hierarchy_built)
+            this->hierarchy.tileChanged(y, x);
+    }
 
-                // search down
-                niter = this->node_map.find({ y+1, x });
-                if(niter != this->node_map.end()) {
-                    this->node_map[std::pair<int,int>{ y+1, x }].up = { y, x };
-                    this->node_map[std::pair<int,int>{ y, x }].down = { y+1, x };
+    // shortest path from 'from' to 'to', both included, written into
+    // path. false (and an empty path) if either end is not walkable or
+    // they aren't connected. reusing the same path buffer between calls
+    // means nothing gets allocated once it is big enough. mode is a
+    // PathMode, JPS is the quickest on corridor heavy maps and HPA on
+    // big maps where the ends are far apart (its paths can be a few
+    // steps longer than shortest). asking the same thing twice without
+    // changing the graph in between is answered from the path cache
+    bool findPath(
+            std::pair<int,int> from, std::pair<int,int> to,
+            std::vector<std::pair<int,int>>& path, int mode = PathMode::ASTAR) {
+        path.clear();
+
+        if(!this->grid.walkable(from.first, from.second) || !this->grid.walkable(to.first, to.second))
+            return false;
+
+        const int start = this->grid.index(from.first, from.second);
+        const int goal  = this->grid.index(to.first, to.second);
+
+        if(!this->components.reachable(this->grid, start, goal))
+            return false;
+
+        bool found = false;
+        const std::vector<int>* cached = this->cache.find(start, goal, mode, this->version, found);
+
+        if(cached == NULL) {
+            if(mode == PathMode::HPA) {
+                if(!this->hierarchy_built) {
+                    this->hierarchy.build(this->grid);
+                    this->hierarchy_built = true;
                 }
-
+                found = this->hierarchy.findPath(this->grid, start, goal, this->cells);
             }
+            else
+                found = this->search.search(mode, this->grid, start, goal, this->cells);
+
+            this->cache.insert(start, goal, mode, this->version, found, this->cells);
+            cached = &this->cells;
         }
 
+        if(!found)
+            return false;
+
+        for(int i : *cached)
+            path.push_back({ this->grid.cellY(i), this->grid.cellX(i) });
+        return true;
     }
 
-    auto searchFor(std::pair<int,int> from, std::pair<int,int> to) 
-            -> std::vector<std::pair<int,int>> {
+    // findPath cut down to the tiles the path turns at (path_smooth.h).
+    // an agent can walk in a straight line from each waypoint to the next
+    // without touching a barrier
+    bool findWaypoints(
+            std::pair<int,int> from, std::pair<int,int> to,
+            std::vector<std::pair<int,int>>& waypoints, int mode = PathMode::ASTAR) {
+        if(!this->findPath(from, to, waypoints, mode))
+            return false;
+
+        this->cells.clear();
+        for(auto& p : waypoints)
+            this->cells.push_back(this->grid.index(p.first, p.second));
+
+        smooth_path(this->grid, this->cells, this->waypoint_cells);
+
+        waypoints.clear();
+        for(int i : this->waypoint_cells)
+            waypoints.push_back({ this->grid.cellY(i), this->grid.cellX(i) });
+        return true;
+    }
 
-        auto iter = this->node_map.find(from);
-        if(iter == this->node_map.end())
-            return {};
+    // whether there is any path at all, without searching for it
+    bool reachable(std::pair<int,int> from, std::pair<int,int> to) {
+        return this->grid.walkable(from.first, from.second) && this->grid.walkable(to.first, to.second) &&
+            this->components.reachable(
+                this->grid, this->grid.index(from.first, from.second), this->grid.index(to.first, to.second));
+    }
 
-        iter = this->node_map.find(to);
-        if(iter == this->node_map.end())
-            return {};
+    // reads the distance table saved next to map_filename, or builds one
+    // if that is missing or out of date. the build is serial, the editor
+    // saves the table next to every map so it is rarely needed. maps with
+    // more than DistanceTable::MAX_NODES walkable cells don't get one.
+    // true if distance() and nextStep() are table lookups afterwards
+    bool loadDistances(const std::string& map_filename) {
+        std::string error;
+        if(this->distances.load(distanceTableName(map_filename), this->grid, error))
+            return true;
+        return this->distances.build(this->grid);
+    }
 
-        for(auto& gn : this->node_map)
-            gn.second.resetFlags();
+    // steps on a shortest path from 'from' to 'to', -1 if there is none.
+    // O(1) with a distance table, a search otherwise
+    int distance(std::pair<int,int> from, std::pair<int,int> to) {
+        if(!this->grid.walkable(from.first, from.second) || !this->grid.walkable(to.first, to.second))
+            return -1;
 
-        // both endpoints exist
-        std::vector<std::pair<int,int>> s;
+        const int start = this->grid.index(from.first, from.second);
+        const int goal  = this->grid.index(to.first, to.second);
 
-        s.push_back(from);
-        while(s.size() > 0) {
-            auto p = s.back();
-            s.pop_back();
-            auto& gn = this->node_map[p];
+        if(this->distances.valid())
+            return this->distances.distance(start, goal);
 
-            // does end at some point
-            if(p == to)
-                return s;
+        if(!this->components.reachable(this->grid, start, goal) ||
+                !this->search.search(PathMode::ASTAR, this->grid, start, goal, this->cells))
+            return -1;
+        return this->cells.size() - 1;
+    }
 
-            if(!this->node_map[p].visited()) {
-                this->node_map[p].visit();
+    // the tile to step onto from 'from' to get closer to 'to'. false if
+    // there is no path or they are the same tile
+    bool nextStep(std::pair<int,int> from, std::pair<int,int> to, std::pair<int,int>& step) {
+        if(!this->grid.walkable(from.first, from.second) || !this->grid.walkable(to.first, to.second))
+            return false;
 
-                if(gn.hasNorth())
-                    s.push_back(gn.up);
+        const int start = this->grid.index(from.first, from.second);
+        const int goal  = this->grid.index(to.first, to.second);
 
-                if(gn.hasSouth())
-                    s.push_back(gn.down);
+        int next = -1;
+        if(this->distances.valid())
+            next = this->distances.nextHop(start, goal);
+        else if(this->components.reachable(this->grid, start, goal) &&
+                this->search.search(PathMode::ASTAR, this->grid, start, goal, this->cells) &&
+                this->cells.size() > 1)
+            next = this->cells[1];
 
-                if(gn.hasWest())
-                    s.push_back(gn.left);
+        if(next < 0)
+            return false;
 
-                if(gn.hasEast())
-                    s.push_back(gn.right);
-            }
-        }
+        step = { this->grid.cellY(next), this->grid.cellX(next) };
+        return true;
+    }
 
+    // same as findPath but hands back a new vector
+    auto searchFor(std::pair<int,int> from, std::pair<int,int> to, int mode = PathMode::ASTAR)
+            -> std::vector<std::pair<int,int>> {
+        std::vector<std::pair<int,int>> path;
+        this->findPath(from, to, path, mode);
+        return path;
     }
 
     void insertSpawnPoint(int y, int x) {
         this->ai_spawn_points.push_back({ y, x });
     }
 
+    const std::vector<std::pair<int,int>>& getSpawnPoints(void) const {
+        return this->ai_spawn_points; }
+
 };
 
 Graph* gen_ai_graph(std::string filename) {
 
-    Graph* gr = new Graph;
+    Graph* gr;
+
+    MappedLevel ml;
+    if(ml.open(filename)) {
+        if(!NavGrid::fits(ml.width(), ml.height())) {
+            std::cout << "level input file " << filename << " is too big for the ai graph" << std::endl;
+            exit(1);
+        }
+
+        gr = new Graph(ml.width(), ml.height());
+
+        for(int y = 0; y < ml.height(); y++) {
+            for(int x = 0; x < ml.width(); x++) {
+                int t = ml.tile(y, x);
+                if(t > 2) {
+                    std::cout << "error reading level input file " << filename << ": row " << y + 1
+                        << ", column " << x + 1 << ": invalid tile " << t << std::endl;
+                    exit(1);
+                }
+
+                if(t != 1) {
+                    gr->insertNewNode(y, x);
+
+                    if(t == 2)
+                        gr->insertSpawnPoint(y, x);
+                }
+            }
+        }
+
+        return gr;
+    }
+
+    TextMapReader rd;
 
-    std::ifstream is(filename);
+    // only the ground floor matters to the ai, any layers above it are ignored
+    int width, height, layers;
+    if(!rd.open(filename) || !rd.readHeader(width, height, layers)) {
+        std::cout << "error reading level input file " << filename << ": " << rd.error() << std::endl;
+        exit(1);
+    }
 
-    std::string token;
-    if(!(is >> token)) {
-        std::cout << "error reading level input file...\n";
+    if(!NavGrid::fits(width, height)) {
+        std::cout << "level input file " << filename << " is too big for the ai graph" << std::endl;
         exit(1);
     }
 
-    for(int y = 0; y < 25; y++) {
-        for(int x = 0; x < 25; x++) {
+    gr = new Graph(width, height);
+
+    for(int y = 0; y < height; y++) {
+        for(int x = 0; x < width; x++) {
 
-            is >> token;
+            int t;
+            if(!rd.readTile(t)) {
+                std::cout << "error reading level input file " << filename << ": " << rd.error() << std::endl;
+                exit(1);
+            }
 
-            if(token != "1") {
+            if(t != 1) {
                 // not a barrier type
                 gr->insertNewNode(y, x);
 
                 // insert spawn points separately
-                if(token == "2")
+                if(t == 2)
                     // ai spawn point
                     gr->insertSpawnPoint(y, x);
 
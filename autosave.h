@@ -0,0 +1,144 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <iostream>
+#include <condition_variable>
+
+#include "tile_map.h"
+#include "collision.h"
+#include "map_io.h"
+#include "nav_graph.h"
+#include "distance_table.h"
+
+// where periodic autosaves of filename go: map.txt -> map.autosave.txt,
+// the extension is kept so the format stays the same
+std::string autosaveFileName(const std::string& filename) {
+    size_t dot = filename.find_last_of('.');
+    size_t slash = filename.find_last_of('/');
+
+    if(dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return filename + ".autosave";
+    return filename.substr(0, dot) + ".autosave" + filename.substr(dot);
+}
+
+// saves maps on a worker thread. the editor hands over a snapshot of the
+// tile map (which shares chunks with the live one, see LayeredTileMap::snapshot)
+// and goes right back to handling events. collision optimization,
+// formatting, the fsync and the distance table all happen on the worker
+class AutoSaver {
+    struct Job {
+        LayeredTileMap map;
+        std::vector<CollisionBox> boxes; // saved as they are unless optimize is set
+        bool optimize;                   // run the optimizer over map instead
+        int collision_mode;
+        bool distances; // also write the map's distance table once it is saved
+    };
+
+    std::thread worker;
+    std::mutex mtx;
+    std::condition_variable cv;
+
+    // filename -> newest snapshot for it. an older request for the same
+    // file that hasn't started yet gets replaced instead of queued
+    std::map<std::string, Job> pending;
+    bool busy;
+    bool stopping;
+
+    AutoSaver(const AutoSaver&) = delete;
+    AutoSaver& operator=(const AutoSaver&) = delete;
+
+    // built serially, this is already off the event thread and even a
+    // table of MAX_NODES nodes is under a tenth of a second
+    void saveDistances(const LayeredTileMap& lm, const std::string& filename) {
+        if(!fitsDistanceTable(lm.layer(0)))
+            return;
+
+        NavGrid g;
+        g.build(lm.layer(0));
+
+        DistanceTable distances;
+        std::string error;
+        if(distances.build(g) && !distances.save(filename, error))
+            std::cout << error << ": " << filename << std::endl;
+    }
+
+    void workerLoop(void) {
+        for(;;) {
+            std::string filename;
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(this->mtx);
+                this->cv.wait(lock, [this] { return this->stopping || !this->pending.empty(); });
+
+                // still finish whatever was asked for before shutting down
+                if(this->pending.empty())
+                    return;
+
+                auto iter = this->pending.begin();
+                filename = iter->first;
+                job = std::move(iter->second);
+                this->pending.erase(iter);
+                this->busy = true;
+            }
+
+            if(job.optimize)
+                job.boxes = optimize_collision_boxes(job.map, job.collision_mode);
+            const auto& boxes = job.boxes;
+
+            std::string error;
+            if(saveMapDurable(filename, job.map, boxes, error)) {
+                std::cout << "saved " << filename << " (" << boxes.size() << " collision boxes)\n" << std::flush;
+
+                // only once the map is on disk, the table has nothing to go
+                // with otherwise. build() skips maps that are too big for one
+                if(job.distances)
+                    this->saveDistances(job.map, distanceTableName(filename));
+            }
+            else
+                std::cout << error << ": " << filename << std::endl;
+
+            std::lock_guard<std::mutex> lock(this->mtx);
+            this->busy = false;
+        }
+    }
+
+public:
+    AutoSaver(void) : busy(false), stopping(false) {
+        this->worker = std::thread(&AutoSaver::workerLoop, this); }
+
+    // waits for pending saves to hit the disk
+    ~AutoSaver(void) {
+        {
+            std::lock_guard<std::mutex> lock(this->mtx);
+            this->stopping = true;
+        }
+        this->cv.notify_one();
+        this->worker.join();
+    }
+
+    // never blocks on disk i/o, only on copying the chunk table and the
+    // rectangles of collisions, the set of the layer being edited. a
+    // single layer map is saved with those, a map with more layers gets
+    // its boxes from the optimizer in collisions' mode. with distances
+    // the map's distance table is saved next to it as well
+    void save(const LayeredTileMap& lm, const std::string& filename, const CollisionSet& collisions, bool distances = false) {
+        const bool optimize = lm.getDepth() > 1;
+
+        Job job = { lm.snapshot(), optimize ? std::vector<CollisionBox>() : collisions.boxes(),
+            optimize, collisions.getMode(), distances };
+
+        {
+            std::lock_guard<std::mutex> lock(this->mtx);
+            this->pending[filename] = std::move(job);
+        }
+        this->cv.notify_one();
+    }
+
+    bool idle(void) {
+        std::lock_guard<std::mutex> lock(this->mtx);
+        return this->pending.empty() && !this->busy;
+    }
+};
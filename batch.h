@@ -0,0 +1,295 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <iostream>
+#include <algorithm>
+
+#include <glob.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "map_format.h"
+#include "tile_map.h"
+#include "collision.h"
+#include "map_io.h"
+#include "thread_pool.h"
+#include "grid_bfs.h"
+#include "distance_table.h"
+
+// headless mode: load a pile of maps, check them, regenerate their
+// collision data and write them back out without ever touching SDL
+
+struct BatchOptions {
+    std::vector<std::string> inputs; // map files, directories or glob patterns
+    std::string format;              // "text", "binary" or empty to keep the input format
+    std::string outdir;              // empty writes next to the input
+    bool in_place;                   // allow an empty outdir, which overwrites the inputs
+    bool distances;                  // write a distance table next to each small map
+    int threads;                     // <= 0 uses every core
+
+    BatchOptions(void) : in_place(false), distances(true), threads(0) {}
+};
+
+struct BatchResult {
+    std::string input;
+    std::string output;
+
+    bool ok;
+    std::string error;
+    std::vector<std::string> warnings;
+
+    int width, height, depth;
+    size_t barriers, spawns, boxes;
+
+    BatchResult(void) : ok(false), width(0), height(0), depth(0), barriers(0), spawns(0), boxes(0) {}
+};
+
+// every map file named by the inputs, sorted and without duplicates.
+// directories contribute their .txt and binary level files
+std::vector<std::string> batch_expand_inputs(const std::vector<std::string>& inputs);
+
+BatchResult batch_process_map(const std::string& input, const BatchOptions& opts);
+
+// returns the process exit code, non-zero if any map failed
+int batch_run(const BatchOptions& opts);
+
+// ==================================================================
+// implementation
+// ==================================================================
+
+static bool batch_has_suffix(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() &&
+        s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static bool batch_is_dir(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+std::vector<std::string> batch_expand_inputs(const std::vector<std::string>& inputs) {
+    std::vector<std::string> files;
+
+    for(auto& in : inputs) {
+        if(batch_is_dir(in)) {
+            DIR* dir = opendir(in.c_str());
+            if(dir == NULL)
+                continue;
+
+            while(dirent* ent = readdir(dir)) {
+                std::string name = ent->d_name;
+                std::string path = in + "/" + name;
+
+                if((batch_has_suffix(name, ".txt") || isBinaryLevelName(name)) && !batch_is_dir(path))
+                    files.push_back(path);
+            }
+            closedir(dir);
+            continue;
+        }
+
+        // plain file names go through glob too, they just match themselves
+        glob_t g;
+        if(glob(in.c_str(), 0, NULL, &g) == 0) {
+            for(size_t i = 0; i < g.gl_pathc; i++)
+                if(!batch_is_dir(g.gl_pathv[i]))
+                    files.push_back(g.gl_pathv[i]);
+        }
+        else {
+            std::cout << "warning: nothing matches " << in << std::endl;
+        }
+        globfree(&g);
+    }
+
+    std::sort(files.begin(), files.end());
+    files.erase(std::unique(files.begin(), files.end()), files.end());
+    return files;
+}
+
+// where the converted copy of input goes
+static std::string batch_output_name(const std::string& input, const BatchOptions& opts) {
+    std::string name = input;
+    std::string dir;
+
+    size_t slash = input.find_last_of('/');
+    if(slash != std::string::npos) {
+        dir  = input.substr(0, slash + 1);
+        name = input.substr(slash + 1);
+    }
+
+    if(!opts.outdir.empty())
+        dir = opts.outdir + "/";
+
+    bool binary = isBinaryLevelName(input);
+    if(opts.format == "binary")
+        binary = true;
+    else if(opts.format == "text")
+        binary = false;
+
+    size_t dot = name.find_last_of('.');
+    if(dot != std::string::npos)
+        name = name.substr(0, dot);
+
+    return dir + name + (binary ? LEVEL_BINARY_EXTENSION : ".txt");
+}
+
+// every spawn point has to be able to walk to every other one, which is
+// the same as all of them being reached by one flood fill out of the
+// first. ai only walks the ground floor
+static void batch_check_spawns(const TileMap& ta, BatchResult& res) {
+    std::vector<std::pair<int,int>> pts;
+    ta.forEachTile([&pts](int y, int x, int type) {
+        if(type == Tile_t::SPAWN_POINT)
+            pts.push_back({ y, x });
+    });
+
+    if(pts.size() < 2)
+        return;
+
+    // cell indices are ints here too
+    if(!NavGrid::fits(ta.getWidth(), ta.getHeight())) {
+        res.warnings.push_back("map too big to check whether spawn points can reach each other");
+        return;
+    }
+
+    GridBFS bfs;
+    bfs.load(ta);
+    bfs.flood(pts[0].first * ta.getWidth() + pts[0].second);
+
+    for(size_t i = 1; i < pts.size(); i++) {
+        if(!bfs.reached(pts[i].first, pts[i].second)) {
+            res.warnings.push_back(
+                "spawn point (" + std::to_string(pts[i].first) + ", " + std::to_string(pts[i].second) +
+                ") cannot reach (" + std::to_string(pts[0].first) + ", " + std::to_string(pts[0].second) + ")");
+        }
+    }
+}
+
+BatchResult batch_process_map(const std::string& input, const BatchOptions& opts) {
+    BatchResult res;
+    res.input = input;
+    res.output = batch_output_name(input, opts);
+
+    LayeredTileMap lm;
+    if(!loadMap(input, lm, res.error))
+        return res;
+
+    res.width    = lm.getWidth();
+    res.height   = lm.getHeight();
+    res.depth    = lm.getDepth();
+    res.barriers = lm.count(Tile_t::BARRIER);
+    res.spawns   = lm.layer(0).count(Tile_t::SPAWN_POINT);
+
+    if(res.spawns == 0)
+        res.warnings.push_back("map has no spawn points on the ground floor");
+
+    batch_check_spawns(lm.layer(0), res);
+
+    auto boxes = optimize_collision_boxes(lm, CollisionMode::RECTANGLES);
+    res.boxes = boxes.size();
+
+    // the output may well be the input itself, a crash halfway through
+    // must not leave a truncated map behind
+    if(!saveMapDurable(res.output, lm, boxes, res.error))
+        return res;
+
+    // small maps get their distance table written next to them. this
+    // already runs on a pool worker, so the table is built on this thread
+    if(opts.distances && fitsDistanceTable(lm.layer(0))) {
+        NavGrid g;
+        g.build(lm.layer(0));
+
+        DistanceTable distances;
+        std::string error;
+        if(distances.build(g) && !distances.save(distanceTableName(res.output), error))
+            res.warnings.push_back(distanceTableName(res.output) + ": " + error);
+    }
+
+    res.ok = true;
+    return res;
+}
+
+int batch_run(const BatchOptions& opts) {
+    if(!opts.format.empty() && opts.format != "text" && opts.format != "binary") {
+        std::cout << "unknown output format: " << opts.format << " (expected text or binary)\n";
+        return 1;
+    }
+
+    if(!opts.outdir.empty() && !batch_is_dir(opts.outdir)) {
+        std::cout << "output directory does not exist: " << opts.outdir << std::endl;
+        return 1;
+    }
+
+    // without an output directory the maps are written over themselves,
+    // which has to be asked for
+    if(opts.outdir.empty() && !opts.in_place) {
+        std::cout << "no output directory, give one with -d or pass --in-place to overwrite the input maps\n";
+        return 1;
+    }
+
+    auto files = batch_expand_inputs(opts.inputs);
+    if(files.empty()) {
+        std::cout << "no map files to process\n";
+        return 1;
+    }
+
+    int failed = 0, warned = 0;
+
+    // inputs that would be written to the same file (foo.txt and foo.lvl
+    // converted to one format, same named maps from different directories
+    // into one -d) would race each other on two workers, all of them fail
+    std::map<std::string, int> writers;
+    for(auto& f : files)
+        writers[batch_output_name(f, opts)]++;
+
+    std::vector<std::string> todo;
+    for(auto& f : files) {
+        const std::string out = batch_output_name(f, opts);
+        if(writers[out] > 1) {
+            failed++;
+            std::cout << "FAIL " << f << ": another input is also written to " << out << '\n';
+        }
+        else
+            todo.push_back(f);
+    }
+
+    if(todo.empty()) {
+        std::cout << files.size() << " maps, " << failed << " failed, 0 with warnings\n" << std::flush;
+        return 1;
+    }
+
+    ThreadPool pool(std::min<int>(opts.threads > 0 ? opts.threads : std::thread::hardware_concurrency(), todo.size()));
+
+    std::mutex print_mtx;
+
+    pool.run(todo.size(), [&](int i, int) {
+        BatchResult res = batch_process_map(todo[i], opts);
+
+        std::lock_guard<std::mutex> lock(print_mtx);
+
+        if(!res.ok) {
+            failed++;
+            std::cout << "FAIL " << res.input << ": " << res.error << '\n';
+            return;
+        }
+
+        std::cout << "ok   " << res.input << " -> " << res.output << " ("
+            << res.width << 'x' << res.height << 'x' << res.depth << ", "
+            << res.barriers << " barriers, "
+            << res.spawns << " spawns, "
+            << res.boxes << " boxes)\n";
+
+        if(!res.warnings.empty())
+            warned++;
+        for(auto& w : res.warnings)
+            std::cout << "     warning: " << w << '\n';
+    });
+
+    std::cout << files.size() << " maps, "
+        << failed << " failed, "
+        << warned << " with warnings\n" << std::flush;
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,3 @@
+#!/bin/bash
+
+g++ -o main main.cpp -std=c++11 -march=native -O3 -pthread
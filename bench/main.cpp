@@ -0,0 +1,507 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <functional>
+#include <cstdio>
+#include <cstdlib>
+#include "../tile_map.h"
+#include "../map_io.h"
+#include "../nav_graph.h"
+#include "../nav_components.h"
+#include "../nav_hierarchy.h"
+#include "../path_search.h"
+#include "../path_batch.h"
+#include "../flow_field.h"
+#include "../grid_bfs.h"
+#include "../thread_pool.h"
+
+using namespace std;
+
+// pathfinding benchmarks over generated maps. every (map family, size)
+// combination goes through the same set of benchmarks and prints one row
+// per benchmark, optionally also written out as CSV so runs before and
+// after a change can be diffed
+
+struct BenchOptions {
+    vector<string> families;
+    vector<int> sizes;
+    int queries;      // path queries per benchmark (fewer if the time runs out)
+    int time_ms;      // time budget per benchmark
+    int threads;      // for the batch benchmark, <= 0 uses every core
+    unsigned seed;
+    string map_file;  // what the "file" family is made from
+    string csv;
+};
+
+struct BenchRow {
+    string family;
+    int size;
+    string bench;
+    size_t nodes;
+    int runs;
+    double ns_per_op;
+    double expanded_per_op;
+    double bytes_per_node;
+    double path_length; // average, 0 where it doesn't apply
+};
+
+typedef chrono::steady_clock bench_clock;
+
+void splitList(const string& s, vector<string>& out);
+bool generateMap(const string& family, int size, unsigned seed, const string& map_file, TileMap& ta);
+void runBenchmarks(const string& family, int size, const TileMap& ta, const BenchOptions& opts, ThreadPool& pool, vector<BenchRow>& rows);
+void printRow(const BenchRow& r);
+bool writeCsv(const string& filename, const vector<BenchRow>& rows);
+
+int main(int argc, char* argv[]) {
+
+    BenchOptions opts;
+    opts.queries = 200;
+    opts.time_ms = 1000;
+    opts.threads = 0;
+    opts.seed = 1;
+    opts.map_file = "../map.txt";
+
+    string families = "maze,arena,rooms,file";
+    string sizes = "25,64,256,1024,4096";
+
+    for(int i = 1; i < argc; i += 2) {
+        string flag = argv[i];
+
+        if(i + 1 >= argc) {
+            flag = "-h";
+        }
+
+        if(flag == "-m")
+            families = argv[i+1];
+        else if(flag == "-s")
+            sizes = argv[i+1];
+        else if(flag == "-q")
+            opts.queries = atoi(argv[i+1]);
+        else if(flag == "-t")
+            opts.time_ms = atoi(argv[i+1]);
+        else if(flag == "-j")
+            opts.threads = atoi(argv[i+1]);
+        else if(flag == "-r")
+            opts.seed = atoi(argv[i+1]);
+        else if(flag == "-f")
+            opts.map_file = argv[i+1];
+        else if(flag == "-c")
+            opts.csv = argv[i+1];
+        else {
+            cout << "Options:\n\n";
+            cout <<
+                " -m <families> (comma separated: maze, arena, rooms, file. default all)\n"
+                " -s <sizes> (comma separated map edge lengths, default 25,64,256,1024,4096)\n"
+                " -q <queries> (path queries per benchmark, default 200)\n"
+                " -t <milliseconds> (time budget per benchmark, default 1000)\n"
+                " -j <threads> (for batch queries, default is every core)\n"
+                " -r <seed> (for map generation and query endpoints, default 1)\n"
+                " -f <map file> (tiled to size for the file family, default ../map.txt)\n"
+                " -c <csv file> (also write the results there)\n\n";
+            return 1;
+        }
+    }
+
+    splitList(families, opts.families);
+
+    vector<string> size_list;
+    splitList(sizes, size_list);
+    for(auto& s : size_list) {
+        int n = atoi(s.c_str());
+        if(n <= 0) {
+            cout << "invalid size: " << s << endl;
+            return 1;
+        }
+        opts.sizes.push_back(n);
+    }
+
+    ThreadPool pool(opts.threads);
+
+    printf("%-6s %5s  %-12s %9s %6s %14s %12s %10s %9s\n",
+        "family", "size", "bench", "nodes", "runs", "ns/op", "expanded/op", "bytes/node", "path");
+
+    vector<BenchRow> rows;
+
+    for(auto& family : opts.families) {
+        for(int size : opts.sizes) {
+            TileMap ta(size, size);
+            if(!generateMap(family, size, opts.seed, opts.map_file, ta))
+                return 1;
+
+            runBenchmarks(family, size, ta, opts, pool, rows);
+        }
+    }
+
+    if(!opts.csv.empty() && !writeCsv(opts.csv, rows)) {
+        cout << "cannot write " << opts.csv << endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+void splitList(const string& s, vector<string>& out) {
+    size_t start = 0;
+    while(start <= s.size()) {
+        size_t comma = s.find(',', start);
+        if(comma == string::npos)
+            comma = s.size();
+        if(comma > start)
+            out.push_back(s.substr(start, comma - start));
+        start = comma + 1;
+    }
+}
+
+// ==================================================================
+// map families
+// ==================================================================
+
+// perfect maze (exactly one way between any two cells), corridors one
+// tile wide. iterative so big mazes don't run out of stack
+static void generateMaze(int size, mt19937& rng, TileMap& ta) {
+    for(int y = 0; y < size; y++)
+        for(int x = 0; x < size; x++)
+            ta.set(y, x, Tile_t::BARRIER);
+
+    // maze cells sit on odd coordinates, the walls between them on even
+    const int cells = (size - 1) / 2;
+    if(cells <= 0)
+        return;
+
+    vector<uint8_t> visited(size_t(cells) * cells, 0);
+    vector<int> stack;
+
+    stack.push_back(0);
+    visited[0] = 1;
+    ta.set(1, 1, Tile_t::DEFAULT);
+
+    const int dy[4] = { -1, 1, 0, 0 };
+    const int dx[4] = { 0, 0, 1, -1 };
+
+    while(!stack.empty()) {
+        const int c = stack.back();
+        const int cy = c / cells;
+        const int cx = c % cells;
+
+        int options[4];
+        int n = 0;
+        for(int d = 0; d < 4; d++) {
+            const int ny = cy + dy[d];
+            const int nx = cx + dx[d];
+            if(ny >= 0 && nx >= 0 && ny < cells && nx < cells && !visited[ny * cells + nx])
+                options[n++] = d;
+        }
+
+        if(n == 0) {
+            stack.pop_back();
+            continue;
+        }
+
+        const int d = options[rng() % n];
+        const int ny = cy + dy[d];
+        const int nx = cx + dx[d];
+
+        visited[ny * cells + nx] = 1;
+        ta.set(2 * cy + 1 + dy[d], 2 * cx + 1 + dx[d], Tile_t::DEFAULT);
+        ta.set(2 * ny + 1, 2 * nx + 1, Tile_t::DEFAULT);
+        stack.push_back(ny * cells + nx);
+    }
+}
+
+// walled arena, open floor with scattered 2x2 pillars
+static void generateArena(int size, mt19937& rng, TileMap& ta) {
+    for(int i = 0; i < size; i++) {
+        ta.set(0, i, Tile_t::BARRIER);
+        ta.set(size - 1, i, Tile_t::BARRIER);
+        ta.set(i, 0, Tile_t::BARRIER);
+        ta.set(i, size - 1, Tile_t::BARRIER);
+    }
+
+    const int pillars = size * size / 80;
+    for(int i = 0; i < pillars; i++) {
+        const int y = 2 + rng() % max(size - 4, 1);
+        const int x = 2 + rng() % max(size - 4, 1);
+        for(int py = y; py < min(y + 2, size - 1); py++)
+            for(int px = x; px < min(x + 2, size - 1); px++)
+                ta.set(py, px, Tile_t::BARRIER);
+    }
+}
+
+// square rooms 8-16 tiles across, every wall between two rooms has one
+// or two doorways
+static void generateRooms(int size, mt19937& rng, TileMap& ta) {
+    vector<int> cuts;
+    for(int p = 0; p < size; p += 9 + rng() % 8)
+        cuts.push_back(p);
+    cuts.push_back(size - 1);
+
+    for(int c : cuts) {
+        for(int i = 0; i < size; i++) {
+            ta.set(c, i, Tile_t::BARRIER);
+            ta.set(i, c, Tile_t::BARRIER);
+        }
+    }
+
+    // doorways through every wall segment between two neighboring rooms
+    for(size_t a = 0; a + 1 < cuts.size(); a++) {
+        for(size_t b = 1; b + 1 < cuts.size(); b++) {
+            const int lo = cuts[a] + 1;
+            const int hi = cuts[a + 1] - 1;
+            if(hi < lo)
+                continue;
+
+            const int doors = 1 + rng() % 2;
+            for(int d = 0; d < doors; d++) {
+                const int p = lo + rng() % (hi - lo + 1);
+                ta.set(cuts[b], p, Tile_t::DEFAULT); // through a horizontal wall
+                ta.set(p, cuts[b], Tile_t::DEFAULT); // through a vertical wall
+            }
+        }
+    }
+}
+
+// the shipped map repeated until it covers size x size. its outer wall
+// would leave every copy an island, so each seam gets a doorway where
+// both sides have floor right behind the wall
+static bool generateFromFile(int size, const string& map_file, TileMap& ta) {
+    LayeredTileMap lm;
+    string error;
+    if(!loadMap(map_file, lm, error)) {
+        cout << map_file << ": " << error << endl;
+        return false;
+    }
+
+    const TileMap& src = lm.layer(0);
+    const int h = src.getHeight();
+    const int w = src.getWidth();
+
+    for(int y = 0; y < size; y++) {
+        for(int x = 0; x < size; x++) {
+            const int t = src.get(y % h, x % w);
+            if(t != Tile_t::DEFAULT)
+                ta.set(y, x, t);
+        }
+    }
+
+    auto floor = [&](int y, int x) { return src.get(y, x) != Tile_t::BARRIER; };
+
+    // doorway row through vertical seams, column through horizontal ones
+    int door_row = -1, door_col = -1;
+    for(int i = 0, y = h / 2; i < h && door_row < 0; i++, y = (y + 1) % h)
+        if(floor(y, 1) && floor(y, w - 2))
+            door_row = y;
+    for(int i = 0, x = w / 2; i < w && door_col < 0; i++, x = (x + 1) % w)
+        if(floor(1, x) && floor(h - 2, x))
+            door_col = x;
+
+    for(int y = 0; door_row >= 0 && y + door_row < size; y += h) {
+        for(int x = w; x < size; x += w) {
+            ta.set(y + door_row, x - 1, Tile_t::DEFAULT);
+            ta.set(y + door_row, x, Tile_t::DEFAULT);
+        }
+    }
+    for(int y = h; y < size; y += h) {
+        for(int x = 0; door_col >= 0 && x + door_col < size; x += w) {
+            ta.set(y - 1, x + door_col, Tile_t::DEFAULT);
+            ta.set(y, x + door_col, Tile_t::DEFAULT);
+        }
+    }
+    return true;
+}
+
+bool generateMap(const string& family, int size, unsigned seed, const string& map_file, TileMap& ta) {
+    mt19937 rng(seed * 7919 + size);
+
+    if(family == "maze")
+        generateMaze(size, rng, ta);
+    else if(family == "arena")
+        generateArena(size, rng, ta);
+    else if(family == "rooms")
+        generateRooms(size, rng, ta);
+    else if(family == "file")
+        return generateFromFile(size, map_file, ta);
+    else {
+        cout << "unknown map family: " << family << endl;
+        return false;
+    }
+    return true;
+}
+
+// ==================================================================
+// benchmarks
+// ==================================================================
+
+static double elapsedNs(bench_clock::time_point start) {
+    return chrono::duration<double, nano>(bench_clock::now() - start).count(); }
+
+// endpoints that are connected, so every query has an answer. the pair
+// list is the same for every search variant
+static void pickQueries(const NavGrid& g, int count, unsigned seed, vector<pair<int,int>>& out) {
+    out.clear();
+    if(g.nodeCount() < 2)
+        return;
+
+    NavComponents cc;
+    cc.build(g);
+
+    mt19937 rng(seed);
+    auto walkable = [&]() {
+        int i;
+        do { i = rng() % g.cellCount(); } while(!g.walkable(i));
+        return i;
+    };
+
+    for(int tries = 0; int(out.size()) < count && tries < count * 100; tries++) {
+        const int a = walkable();
+        const int b = walkable();
+        if(a != b && cc.reachable(g, a, b))
+            out.push_back({ a, b });
+    }
+}
+
+void runBenchmarks(const string& family, int size, const TileMap& ta, const BenchOptions& opts, ThreadPool& pool, vector<BenchRow>& rows) {
+
+    const double budget = opts.time_ms * 1e6;
+
+    NavGrid g;
+
+    // times fn until it has run count times or the budget is gone, at
+    // least once. fn(i) returns (expanded, path length) for run i, memory
+    // is what the benchmark keeps around once it is done
+    auto measure = [&](const string& bench, int count,
+            std::function<pair<size_t,size_t>(int)> fn, std::function<size_t()> memory) {
+
+        BenchRow r = { family, size, bench, 0, 0, 0, 0, 0, 0 };
+
+        double ns = 0, expanded = 0, length = 0;
+        while(r.runs < max(count, 1) && (r.runs == 0 || ns < budget)) {
+            auto start = bench_clock::now();
+            auto res = fn(r.runs);
+            ns += elapsedNs(start);
+
+            expanded += res.first;
+            length += res.second;
+            r.runs++;
+        }
+
+        r.nodes = g.nodeCount();
+        r.ns_per_op = ns / r.runs;
+        r.expanded_per_op = expanded / r.runs;
+        r.path_length = length / r.runs;
+        r.bytes_per_node = r.nodes ? double(memory()) / r.nodes : 0;
+
+        printRow(r);
+        rows.push_back(r);
+    };
+
+    measure("build", 1, [&](int) {
+        g.build(ta);
+        return make_pair(g.nodeCount(), size_t(0));
+    }, [&]() { return g.memoryUsage(); });
+
+    const size_t nodes = g.nodeCount();
+    if(nodes < 2)
+        return;
+
+    vector<pair<int,int>> queries;
+    pickQueries(g, opts.queries, opts.seed, queries);
+    if(queries.empty())
+        return;
+
+    const int q = queries.size();
+
+    // single pair searches, one after another
+    PathSearch search;
+    vector<int> path;
+
+    const pair<const char*, int> modes[] = {
+        { "astar", PathMode::ASTAR }, { "bfs", PathMode::BFS }, { "jps", PathMode::JPS } };
+
+    for(auto& m : modes) {
+        // one untimed search so scratch allocation isn't counted
+        search.search(m.second, g, queries[0].first, queries[0].second, path);
+
+        measure(m.first, q, [&](int i) {
+            search.search(m.second, g, queries[i % q].first, queries[i % q].second, path);
+            return make_pair(search.lastExpanded(), path.size());
+        }, [&]() { return g.memoryUsage() + search.memoryUsage(); });
+    }
+
+    // hierarchical, building the clusters is its own row
+    NavHierarchy hierarchy;
+    measure("hpa-build", 1, [&](int) {
+        hierarchy.build(g);
+        return make_pair(size_t(hierarchy.entranceCount()), size_t(0));
+    }, [&]() { return g.memoryUsage() + hierarchy.memoryUsage(); });
+
+    measure("hpa", q, [&](int i) {
+        hierarchy.findPath(g, queries[i % q].first, queries[i % q].second, path);
+        return make_pair(hierarchy.lastExpanded(), path.size());
+    }, [&]() { return g.memoryUsage() + hierarchy.memoryUsage(); });
+
+    // every query in one batch on the pool, timed as a whole
+    {
+        PathBatch batch(pool);
+        PathBatchResult result;
+        batch.run(g, queries, result, PathMode::ASTAR); // warm up
+
+        BenchRow r = { family, size, "batch-astar", nodes, 0, 0, 0, 0, 0 };
+        double ns = 0;
+        while(r.runs == 0 || ns < budget) {
+            auto start = bench_clock::now();
+            batch.run(g, queries, result, PathMode::ASTAR);
+            ns += elapsedNs(start);
+            r.runs += q;
+        }
+        r.ns_per_op = ns / r.runs;
+        r.path_length = double(result.cells.size()) / q;
+        r.bytes_per_node = double(g.memoryUsage() + batch.memoryUsage()) / nodes;
+
+        printRow(r);
+        rows.push_back(r);
+    }
+
+    // distance fields toward one target, every cell gets a distance
+    FlowField flow;
+    unsigned long version = 0;
+    measure("flowfield", q, [&](int i) {
+        flow.update(g, queries[i % q].second, version++);
+        return make_pair(nodes, size_t(0));
+    }, [&]() { return g.memoryUsage() + flow.memoryUsage(); });
+
+    // reachability from one target, no distances
+    GridBFS bfs;
+    bfs.load(ta);
+    measure("flood", q, [&](int i) {
+        return make_pair(size_t(bfs.flood(queries[i % q].second)), size_t(0));
+    }, [&]() { return bfs.memoryUsage(); });
+}
+
+// ==================================================================
+// output
+// ==================================================================
+
+void printRow(const BenchRow& r) {
+    printf("%-6s %5d  %-12s %9zu %6d %14.0f %12.1f %10.2f %9.1f\n",
+        r.family.c_str(), r.size, r.bench.c_str(), r.nodes, r.runs,
+        r.ns_per_op, r.expanded_per_op, r.bytes_per_node, r.path_length);
+    fflush(stdout);
+}
+
+bool writeCsv(const string& filename, const vector<BenchRow>& rows) {
+    FILE* fp = fopen(filename.c_str(), "w");
+    if(fp == NULL)
+        return false;
+
+    fprintf(fp, "family,size,bench,nodes,runs,ns_per_op,expanded_per_op,bytes_per_node,path_length\n");
+    for(auto& r : rows) {
+        fprintf(fp, "%s,%d,%s,%zu,%d,%.1f,%.2f,%.3f,%.2f\n",
+            r.family.c_str(), r.size, r.bench.c_str(), r.nodes, r.runs,
+            r.ns_per_op, r.expanded_per_op, r.bytes_per_node, r.path_length);
+    }
+
+    return fclose(fp) == 0;
+}
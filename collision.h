@@ -0,0 +1,454 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+
+#include "tile_map.h"
+
+// we want to have as few of these as possible for a given map
+struct CollisionGeometry {
+    // basically just a SDL_Rect but with larger data type
+    int x;
+    int y;
+    int w;
+    int h;
+};
+
+// how optimize_collision_entities() carves barriers into rectangles
+struct CollisionMode {
+    static const int RUNS       = 0; // 1-tile-thick horizontal or vertical runs
+    static const int RECTANGLES = 1; // greedy 2D merge into full rectangles
+};
+
+// axis aligned box spanning layers [z, z+d) of a LayeredTileMap. x/y/w/h
+// mean the same as in CollisionGeometry
+struct CollisionBox {
+    int x;
+    int y;
+    int z;
+    int w;
+    int h;
+    int d;
+};
+
+std::vector<CollisionGeometry> optimize_collision_entities(TileMap& ta, int mode = CollisionMode::RECTANGLES);
+
+// same idea in 3D: every rectangle is also stretched up through the layers
+// above for as long as they are solid over its whole footprint, so a
+// pillar or a wall running through several floors is a single box
+std::vector<CollisionBox> optimize_collision_boxes(LayeredTileMap& lm, int mode = CollisionMode::RECTANGLES);
+
+// ==================================================================
+// implementation
+// ==================================================================
+
+// grows a rectangle out of the untracked barrier at (y, x). it may run over
+// barriers that are already covered, overlapping static bodies are fine and
+// it keeps the rectangle count down. tries both row-first and column-first
+// and keeps whichever covers more tiles
+CollisionGeometry collision_grow_rect(const TileMap& ta, int y, int x) {
+
+    // row first: as wide as possible, then as tall as that width allows
+    int w1 = ta.barrierRunH(y, x);
+    int h1 = 1;
+    while(ta.barrierSpan(y + h1, x, w1))
+        h1++;
+
+    // column first: as tall as possible, then as wide as that height allows
+    int h2 = ta.barrierRunV(y, x);
+    int w2 = 1;
+    for(;;) {
+        int i = 0;
+        while(i < h2 && ta.barrierSpan(y + i, x + w2, 1))
+            i++;
+
+        if(i < h2)
+            break;
+        w2++;
+    }
+
+    CollisionGeometry cg;
+    cg.x = x;
+    cg.y = y;
+
+    // equal area favors the row-first shape
+    if(w1 * h1 >= w2 * h2) {
+        cg.w = w1;
+        cg.h = h1;
+    }
+    else {
+        cg.w = w2;
+        cg.h = h2;
+    }
+
+    return cg;
+}
+
+// the rectangle optimize_collision_entities() starts at (y, x) in the given mode
+CollisionGeometry collision_grow(const TileMap& ta, int y, int x, int mode) {
+
+    if(mode == CollisionMode::RECTANGLES)
+        return collision_grow_rect(ta, y, x);
+
+    CollisionGeometry cg;
+    cg.x = x;
+    cg.y = y;
+
+    int hlen = ta.barrierRunH(y, x);
+    int vlen = ta.barrierRunV(y, x);
+
+    if(hlen >= vlen) {
+        // equal length favors hlen
+        cg.h = 1;
+        cg.w = hlen;
+    }
+    else {
+        cg.h = vlen;
+        cg.w = 1;
+    }
+
+    return cg;
+}
+
+// calls f(y, x) for the first untracked barrier, lets it track whatever it
+// covers and moves on to the next one. only allocated chunks can hold
+// barriers and each chunk row is one word, so untracked barriers are found
+// a whole row segment at a time. words are read through ta, not the chunk
+// handed to forEachChunk: tracking can swap a chunk that is shared with a
+// snapshot for a private copy
+template<typename F>
+void collision_scan_untracked(const TileMap& ta, F f) {
+    ta.forEachChunk([&](int cy, int cx, const TileChunk&) {
+        for(int r = 0; r < TILE_CHUNK_SIZE; r++) {
+
+            const int y = (cy << TILE_CHUNK_SHIFT) + r;
+
+            TileWord_t todo = ta.barrierWord(y, cx) & ~ta.trackedWord(y, cx);
+            while(todo) {
+
+                const int bit = __builtin_ctzll(todo);
+                f(y, (cx << TILE_CHUNK_SHIFT) + bit);
+
+                // tracking may have eaten more of this row, re-read it
+                todo = ta.barrierWord(y, cx) & ~ta.trackedWord(y, cx) & ~((TileWord_t(2) << bit) - 1);
+            }
+        }
+    });
+}
+
+std::vector<CollisionGeometry> optimize_collision_entities(TileMap& ta, int mode) {
+
+    //cout << "optimizing collision geometry...\n" << flush;
+
+    std::vector<CollisionGeometry> vcollide;
+
+    collision_scan_untracked(ta, [&](int y, int x) {
+        CollisionGeometry cg = collision_grow(ta, y, x, mode);
+
+        for(int i = 0; i < cg.h; i++)
+            ta.track(y + i, x, cg.w);
+
+        vcollide.push_back(cg);
+    });
+
+    // reset all tracking data
+    ta.clearTracked();
+
+    return vcollide;
+}
+
+std::vector<CollisionBox> optimize_collision_boxes(LayeredTileMap& lm, int mode) {
+
+    std::vector<CollisionBox> boxes;
+
+    for(int z = 0; z < lm.getDepth(); z++) {
+        TileMap& ta = lm.layer(z);
+
+        collision_scan_untracked(ta, [&](int y, int x) {
+            CollisionGeometry cg = collision_grow(ta, y, x, mode);
+
+            // stack it upwards while the next layer is solid under the
+            // whole footprint. covered barriers up there get tracked so
+            // they don't start boxes of their own
+            int d = 1;
+            for(; z + d < lm.getDepth(); d++) {
+                const TileMap& above = lm.layer(z + d);
+
+                int i = 0;
+                while(i < cg.h && above.barrierSpan(cg.y + i, cg.x, cg.w))
+                    i++;
+
+                if(i < cg.h)
+                    break;
+            }
+
+            for(int k = 0; k < d; k++)
+                for(int i = 0; i < cg.h; i++)
+                    lm.layer(z + k).track(cg.y + i, cg.x, cg.w);
+
+            boxes.push_back({ cg.x, cg.y, z, cg.w, cg.h, d });
+        });
+    }
+
+    for(int z = 0; z < lm.getDepth(); z++)
+        lm.layer(z).clearTracked();
+
+    return boxes;
+}
+
+// persistent collision rectangles for a map that gets edited one tile at
+// a time. edits only split/merge the rectangles around the changed tile,
+// rebuild() runs the full optimizer and is only needed on load or when
+// the mode changes. the patched set isn't as tight as a fresh one: after
+// a few hundred random edits it has ~8% more rectangles (up to ~30% on
+// small maps), and a single layer map is saved with exactly those so
+// saving doesn't pay for the optimizer. a set only knows one layer, the
+// boxes of a map with several are stacked across layers by the
+// optimizer when it is saved
+class CollisionSet {
+    int mode;
+
+    std::vector<CollisionGeometry> rects; // slot array, dead slots have w == 0
+    std::vector<int> free_slots;
+    int live;
+
+    // chunk key -> slots of every rectangle overlapping that chunk
+    std::unordered_map<uint64_t, std::vector<int>> buckets;
+
+    // bounding box of everything added/removed during the current update()
+    CollisionGeometry touched;
+
+    void touch(const CollisionGeometry& cg) {
+        if(this->touched.w == 0) {
+            this->touched = cg;
+            return;
+        }
+
+        const int x0 = std::min(this->touched.x, cg.x), y0 = std::min(this->touched.y, cg.y);
+        this->touched.w = std::max(this->touched.x + this->touched.w, cg.x + cg.w) - x0;
+        this->touched.h = std::max(this->touched.y + this->touched.h, cg.y + cg.h) - y0;
+        this->touched.x = x0;
+        this->touched.y = y0;
+    }
+
+    template<typename F>
+    void forEachBucket(const CollisionGeometry& cg, F f) {
+        for(int cy = cg.y >> TILE_CHUNK_SHIFT; cy <= (cg.y + cg.h - 1) >> TILE_CHUNK_SHIFT; cy++)
+            for(int cx = cg.x >> TILE_CHUNK_SHIFT; cx <= (cg.x + cg.w - 1) >> TILE_CHUNK_SHIFT; cx++)
+                f(this->buckets[TileMap::chunkKey(cy, cx)]);
+    }
+
+    int add(const CollisionGeometry& cg) {
+        int id;
+        if(this->free_slots.empty()) {
+            id = this->rects.size();
+            this->rects.push_back(cg);
+        }
+        else {
+            id = this->free_slots.back();
+            this->free_slots.pop_back();
+            this->rects[id] = cg;
+        }
+
+        this->forEachBucket(cg, [id](std::vector<int>& b) { b.push_back(id); });
+        this->touch(cg);
+        this->live++;
+        return id;
+    }
+
+    void remove(int id) {
+        this->touch(this->rects[id]);
+        this->forEachBucket(this->rects[id], [id](std::vector<int>& b) {
+            b.erase(std::find(b.begin(), b.end(), id)); });
+
+        this->rects[id].w = 0;
+        this->free_slots.push_back(id);
+        this->live--;
+    }
+
+    // every live rectangle that contains (y, x)
+    std::vector<int> rectsAt(int y, int x) {
+        std::vector<int> hits;
+
+        auto iter = this->buckets.find(TileMap::chunkKey(y >> TILE_CHUNK_SHIFT, x >> TILE_CHUNK_SHIFT));
+        if(iter == this->buckets.end())
+            return hits;
+
+        for(int id : iter->second) {
+            const CollisionGeometry& r = this->rects[id];
+            if(x >= r.x && x < r.x + r.w && y >= r.y && y < r.y + r.h)
+                hits.push_back(id);
+        }
+        return hits;
+    }
+
+    // a rectangle that can be glued onto side of cg to form a larger
+    // rectangle, -1 if there isn't one
+    int mergePartner(const CollisionGeometry& cg) {
+        const bool runs = (this->mode == CollisionMode::RUNS);
+
+        // probe one tile past each edge
+        const int probe[4][2] = {
+            { cg.y, cg.x - 1 }, { cg.y, cg.x + cg.w },
+            { cg.y - 1, cg.x }, { cg.y + cg.h, cg.x } };
+
+        for(int side = 0; side < 4; side++) {
+            auto iter = this->buckets.find(TileMap::chunkKey(probe[side][0] >> TILE_CHUNK_SHIFT, probe[side][1] >> TILE_CHUNK_SHIFT));
+            if(iter == this->buckets.end())
+                continue;
+
+            for(int id : iter->second) {
+                const CollisionGeometry& m = this->rects[id];
+
+                bool ok;
+                if(side == 0)      ok = m.y == cg.y && m.h == cg.h && m.x + m.w == cg.x;
+                else if(side == 1) ok = m.y == cg.y && m.h == cg.h && m.x == cg.x + cg.w;
+                else if(side == 2) ok = m.x == cg.x && m.w == cg.w && m.y + m.h == cg.y;
+                else               ok = m.x == cg.x && m.w == cg.w && m.y == cg.y + cg.h;
+
+                // runs stay 1 tile thick
+                if(ok && runs)
+                    ok = (side < 2) ? (cg.h == 1) : (cg.w == 1);
+
+                if(ok)
+                    return id;
+            }
+        }
+
+        return -1;
+    }
+
+    // adds cg and keeps gluing neighbors onto it while that is possible
+    void addMerged(CollisionGeometry cg) {
+        for(int id; (id = this->mergePartner(cg)) >= 0; ) {
+            const CollisionGeometry m = this->rects[id];
+            this->remove(id);
+
+            const int x0 = std::min(cg.x, m.x), y0 = std::min(cg.y, m.y);
+            cg.w = std::max(cg.x + cg.w, m.x + m.w) - x0;
+            cg.h = std::max(cg.y + cg.h, m.y + m.h) - y0;
+            cg.x = x0;
+            cg.y = y0;
+        }
+
+        this->add(cg);
+    }
+
+public:
+    CollisionSet(void) : mode(CollisionMode::RECTANGLES), live(0) {
+        this->touched.w = 0; }
+
+    int getMode(void) const { return this->mode; }
+    size_t size(void) const { return this->live; }
+
+    void rebuild(TileMap& ta, int mode) {
+        this->mode = mode;
+        this->rects.clear();
+        this->free_slots.clear();
+        this->buckets.clear();
+        this->live = 0;
+
+        for(auto& cg : optimize_collision_entities(ta, mode))
+            this->add(cg);
+    }
+
+    // call after the tile at (y, x) changed. returns the bounding box of
+    // every rectangle that was added or removed (w == 0 if none were)
+    CollisionGeometry update(const TileMap& ta, int y, int x, bool was_barrier) {
+        const bool is_barrier = (ta.get(y, x) == Tile_t::BARRIER);
+
+        this->touched.w = 0;
+
+        if(is_barrier == was_barrier)
+            return this->touched;
+
+        if(is_barrier) {
+            CollisionGeometry cg = { x, y, 1, 1 };
+            this->addMerged(cg);
+            return this->touched;
+        }
+
+        // split everything covering the tile into the (up to) four
+        // bands around it. those are all still barriers. every covering
+        // rectangle goes before any piece is added back: rectangles can
+        // overlap, and a piece merged into one that still covers the tile
+        // would put the tile back and free that rectangle's slot twice
+        std::vector<CollisionGeometry> covering;
+        for(int id : this->rectsAt(y, x)) {
+            covering.push_back(this->rects[id]);
+            this->remove(id);
+        }
+
+        for(auto& r : covering) {
+            const CollisionGeometry pieces[4] = {
+                { r.x,   r.y,   r.w,               y - r.y           }, // above
+                { r.x,   y + 1, r.w,               r.y + r.h - y - 1 }, // below
+                { r.x,   y,     x - r.x,           1                 }, // left
+                { x + 1, y,     r.x + r.w - x - 1, 1                 }  // right
+            };
+
+            for(auto& p : pieces)
+                if(p.w > 0 && p.h > 0)
+                    this->addMerged(p);
+        }
+
+        return this->touched;
+    }
+
+    // whether the set describes ta exactly: every rectangle only covers
+    // barriers (and in RUNS mode is one tile thick) and every barrier is
+    // covered. walks the whole map, meant for debugging edits
+    bool consistent(const TileMap& ta) const {
+        std::vector<uint8_t> covered(size_t(ta.getWidth()) * ta.getHeight(), 0);
+        bool ok = true;
+
+        this->forEach([&](const CollisionGeometry& cg) {
+            if(this->mode == CollisionMode::RUNS && cg.w != 1 && cg.h != 1)
+                ok = false;
+
+            for(int y = cg.y; ok && y < cg.y + cg.h; y++) {
+                for(int x = cg.x; ok && x < cg.x + cg.w; x++) {
+                    if(!ta.inBounds(y, x) || ta.get(y, x) != Tile_t::BARRIER)
+                        ok = false;
+                    else
+                        covered[size_t(y) * ta.getWidth() + x] = 1;
+                }
+            }
+        });
+
+        if(!ok)
+            return false;
+
+        bool all = true;
+        ta.forEachTile([&](int y, int x, int type) {
+            if(type == Tile_t::BARRIER && !covered[size_t(y) * ta.getWidth() + x])
+                all = false;
+        });
+        return all;
+    }
+
+    // live rectangles in no particular order. f(const CollisionGeometry&)
+    template<typename F>
+    void forEach(F f) const {
+        for(auto& cg : this->rects)
+            if(cg.w > 0)
+                f(cg);
+    }
+
+    // the rectangles as one layer deep boxes on layer z
+    std::vector<CollisionBox> boxes(int z = 0) const {
+        std::vector<CollisionBox> v;
+        v.reserve(this->live);
+        this->forEach([&v, z](const CollisionGeometry& cg) { v.push_back({ cg.x, cg.y, z, cg.w, cg.h, 1 }); });
+        return v;
+    }
+
+    std::vector<CollisionGeometry> get(void) const {
+        std::vector<CollisionGeometry> v;
+        v.reserve(this->live);
+        this->forEach([&v](const CollisionGeometry& cg) { v.push_back(cg); });
+        return v;
+    }
+};
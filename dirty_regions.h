@@ -0,0 +1,100 @@
+#pragma once
+
+#include <SDL/SDL.h>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+// keeps track of which on-screen tiles changed since the last frame so
+// only those get redrawn and pushed to the display. coordinates are in
+// screen tiles (not map tiles), anything off screen is ignored
+class DirtyRegions {
+    int rows;
+    int cols;
+    int tile_px;
+    int screen_w;
+    int screen_h;
+
+    std::vector<uint8_t> tiles;
+    int count;
+    bool full;
+
+public:
+    DirtyRegions(int rows, int cols, int tile_px, int screen_w, int screen_h) :
+            rows(rows), cols(cols), tile_px(tile_px), screen_w(screen_w), screen_h(screen_h),
+            tiles(rows * cols, 0), count(0), full(true) {}
+
+    void markTile(int ty, int tx) {
+        if(ty < 0 || tx < 0 || ty >= this->rows || tx >= this->cols)
+            return;
+
+        uint8_t& t = this->tiles[ty * this->cols + tx];
+        if(!t) {
+            t = 1;
+            this->count++;
+        }
+    }
+
+    // h x w tiles with the top-left at (ty, tx), clipped to the screen
+    void markArea(int ty, int tx, int h, int w) {
+        const int y0 = std::max(ty, 0), y1 = std::min(ty + h, this->rows);
+        const int x0 = std::max(tx, 0), x1 = std::min(tx + w, this->cols);
+
+        for(int y = y0; y < y1; y++)
+            for(int x = x0; x < x1; x++)
+                this->markTile(y, x);
+    }
+
+    // the whole screen, including the part that isn't covered by tiles
+    void markAll(void) { this->full = true; }
+
+    bool isFull(void) const { return this->full; }
+    bool empty(void) const { return !this->full && this->count == 0; }
+
+    bool isDirty(int ty, int tx) const {
+        return this->full || this->tiles[ty * this->cols + tx]; }
+
+    // pixel rectangles covering every dirty tile, one per horizontal run
+    std::vector<SDL_Rect> spans(void) const {
+        std::vector<SDL_Rect> v;
+
+        if(this->full) {
+            SDL_Rect r;
+            r.x = 0;
+            r.y = 0;
+            r.w = this->screen_w;
+            r.h = this->screen_h;
+            v.push_back(r);
+            return v;
+        }
+
+        for(int y = 0; y < this->rows; y++) {
+            for(int x = 0; x < this->cols; ) {
+                if(!this->tiles[y * this->cols + x]) {
+                    x++;
+                    continue;
+                }
+
+                int start = x;
+                while(x < this->cols && this->tiles[y * this->cols + x])
+                    x++;
+
+                SDL_Rect r;
+                r.x = start * this->tile_px;
+                r.y = y * this->tile_px;
+                r.w = (x - start) * this->tile_px;
+                r.h = this->tile_px;
+                v.push_back(r);
+            }
+        }
+
+        return v;
+    }
+
+    void clear(void) {
+        if(this->count)
+            std::fill(this->tiles.begin(), this->tiles.end(), 0);
+        this->count = 0;
+        this->full = false;
+    }
+};
@@ -0,0 +1,388 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#include "nav_graph.h"
+
+/*
+    shortest distance between every pair of walkable cells of a small map,
+    one BFS per cell, uint16 per pair. a 25x25 map has at most 625 walkable
+    cells, which is ~760KB of table, and after that distance() is a single
+    array read and nextHop() at most four. anything over MAX_NODES walkable
+    cells is left alone, the table grows with the square of it.
+
+    the table can be kept next to its map (distanceTableName()) so it
+    doesn't have to be rebuilt every time the map is loaded. that file is:
+
+        DistanceFileHeader       32 bytes
+        one varint per pair      row by row, row a is the distances from
+                                 node a to every node b in order
+
+    nodes are the walkable cells in row-major order. each value is the
+    zigzag encoded difference to the previous value in the row, where a
+    distance d is stored as d + 1 and no path at all as 0. consecutive
+    nodes are mostly next to each other so nearly every difference is one
+    step and fits in a byte, half the size of the table itself. fingerprint
+    is a hash of which cells are walkable, a file that doesn't match the
+    map it is loaded for is refused
+*/
+
+#define DISTANCE_FILE_MAGIC     "DIST"
+#define DISTANCE_FILE_VERSION   1
+#define DISTANCE_FILE_EXTENSION ".dist"
+
+struct DistanceFileHeader {
+    char     magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t nodes;
+    uint32_t reserved;
+    uint64_t fingerprint;
+};
+
+static_assert(sizeof(DistanceFileHeader) == 32, "DistanceFileHeader must be packed");
+
+// where the distance table of a map file lives
+std::string distanceTableName(const std::string& map_filename) {
+    return map_filename + DISTANCE_FILE_EXTENSION; }
+
+// whether the walkable cells of ta could fit in a DistanceTable. counts
+// the barrier chunks, so a huge map is turned away without building a
+// NavGrid for it first
+bool fitsDistanceTable(const TileMap& ta);
+
+class DistanceTable {
+public:
+    enum { MAX_NODES = 2048 };
+    enum { UNREACHABLE = 0xFFFF };
+
+private:
+    int width;
+    int height;
+    int nodes;
+    uint64_t fingerprint;
+
+    std::vector<uint16_t> table;    // nodes * nodes, row a is from node a
+    std::vector<int> node_cell;     // cell of each node
+    std::vector<int> cell_node;     // node of each cell, -1 for walls
+    std::vector<uint8_t> node_links; // NavDir bits of each node
+
+    // FNV-1a over the size and the walkable cells
+    static uint64_t fingerprintOf(const NavGrid& g) {
+        uint64_t h = 14695981039346656037ull;
+        auto mix = [&h](uint32_t v) {
+            for(int k = 0; k < 4; k++) {
+                h ^= (v >> (k * 8)) & 0xFF;
+                h *= 1099511628211ull;
+            }
+        };
+
+        mix(g.getWidth());
+        mix(g.getHeight());
+        for(int i = 0; i < g.cellCount(); i++)
+            mix(g.walkable(i));
+        return h;
+    }
+
+    // everything but the table itself
+    void loadGrid(const NavGrid& g) {
+        this->width = g.getWidth();
+        this->height = g.getHeight();
+        this->fingerprint = fingerprintOf(g);
+
+        this->node_cell.clear();
+        this->node_links.clear();
+        this->cell_node.assign(g.cellCount(), -1);
+
+        for(int i = 0; i < g.cellCount(); i++) {
+            if(!g.walkable(i))
+                continue;
+            this->cell_node[i] = this->node_cell.size();
+            this->node_cell.push_back(i);
+            this->node_links.push_back(g.links(i));
+        }
+
+        this->nodes = this->node_cell.size();
+    }
+
+    // fills row a with a BFS from node a. queue is scratch, nodes long
+    void fillRow(int a, const std::vector<int>& adjacent, std::vector<int>& queue) {
+        uint16_t* row = this->table.data() + size_t(a) * this->nodes;
+        std::fill(row, row + this->nodes, uint16_t(UNREACHABLE));
+
+        row[a] = 0;
+        queue[0] = a;
+
+        for(int head = 0, tail = 1; head < tail; head++) {
+            const int u = queue[head];
+            for(int k = 0; k < 4; k++) {
+                const int v = adjacent[u * 4 + k];
+                if(v >= 0 && row[v] == UNREACHABLE) {
+                    row[v] = row[u] + 1;
+                    queue[tail++] = v;
+                }
+            }
+        }
+    }
+
+    // sizes the table for g and lists up to four neighbor nodes per node
+    // (-1 where there is none) into adjacent. false if g is too big
+    bool prepare(const NavGrid& g, std::vector<int>& adjacent) {
+        this->clear();
+        if(g.nodeCount() > MAX_NODES)
+            return false;
+
+        this->loadGrid(g);
+
+        const int n = this->nodes;
+        this->table.resize(size_t(n) * n);
+
+        adjacent.assign(size_t(n) * 4, -1);
+        for(int a = 0; a < n; a++) {
+            int k = 0;
+            g.forEachNeighbor(this->node_cell[a], [&](int j) { adjacent[a * 4 + k++] = this->cell_node[j]; });
+        }
+        return true;
+    }
+
+    static uint32_t zigzag(int v) { return (uint32_t(v) << 1) ^ uint32_t(v >> 31); }
+    static int unzigzag(uint32_t v) { return int(v >> 1) ^ -int(v & 1); }
+
+public:
+    DistanceTable(void) : width(0), height(0), nodes(0), fingerprint(0) {}
+
+    // false (and an empty table) if g has more than MAX_NODES walkable
+    // cells, one BFS per node on this thread
+    bool build(const NavGrid& g) {
+        std::vector<int> adjacent;
+        if(!this->prepare(g, adjacent))
+            return false;
+
+        std::vector<int> queue(this->nodes);
+        for(int a = 0; a < this->nodes; a++)
+            this->fillRow(a, adjacent, queue);
+        return true;
+    }
+
+    // same with the rows split between the workers of a ThreadPool (a
+    // template so that users of the serial build don't need threads). must
+    // not be called from one of that pool's own jobs
+    template<typename Pool>
+    bool build(const NavGrid& g, Pool& pool) {
+        std::vector<int> adjacent;
+        if(!this->prepare(g, adjacent))
+            return false;
+
+        std::vector<std::vector<int>> queues(pool.size(), std::vector<int>(this->nodes));
+        pool.run(this->nodes, [&](int a, int worker) { this->fillRow(a, adjacent, queues[worker]); });
+        return true;
+    }
+
+    void clear(void) {
+        this->width = this->height = this->nodes = 0;
+        this->fingerprint = 0;
+        this->table.clear();
+        this->node_cell.clear();
+        this->cell_node.clear();
+        this->node_links.clear();
+    }
+
+    // whether there is a table, and whether it is the one for g
+    bool valid(void) const { return !this->cell_node.empty(); }
+    bool matches(const NavGrid& g) const {
+        return this->valid() && this->width == g.getWidth() && this->height == g.getHeight() &&
+            this->fingerprint == fingerprintOf(g); }
+
+    int nodeCount(void) const { return this->nodes; }
+
+    size_t memoryUsage(void) const {
+        return this->table.capacity() * sizeof(uint16_t) +
+            (this->node_cell.capacity() + this->cell_node.capacity()) * sizeof(int) + this->node_links.capacity(); }
+
+    // steps from cell a to cell b (y*width+x), -1 if either is a wall or
+    // there is no path
+    int distance(int a, int b) const {
+        const int na = this->cell_node[a];
+        const int nb = this->cell_node[b];
+        if(na < 0 || nb < 0)
+            return -1;
+
+        const uint16_t d = this->table[size_t(na) * this->nodes + nb];
+        return d == UNREACHABLE ? -1 : d;
+    }
+
+    // the cell after a on a shortest path from a to b, b itself once it
+    // is next to a, -1 if there is no path or a == b
+    int nextHop(int a, int b) const {
+        const int d = this->distance(a, b);
+        if(d <= 0)
+            return -1;
+
+        const uint8_t l = this->node_links[this->cell_node[a]];
+        const int nb = this->cell_node[b];
+
+        // same order NavGrid::forEachNeighbor goes in
+        const int steps[4] = { -this->width, this->width, 1, -1 };
+        for(int k = 0; k < 4; k++) {
+            if(!(l & (1 << k)))
+                continue;
+
+            const int j = a + steps[k];
+            if(this->table[size_t(this->cell_node[j]) * this->nodes + nb] == d - 1)
+                return j;
+        }
+        return -1;
+    }
+
+    // written to a temporary file that is renamed over filename, so a
+    // crash leaves either the old table or the new one. no fsync, a table
+    // that didn't make it to disk is refused by load() and rebuilt
+    bool save(const std::string& filename, std::string& error) const {
+        if(!this->valid()) {
+            error = "no distance table to save";
+            return false;
+        }
+
+        DistanceFileHeader hdr;
+        memcpy(hdr.magic, DISTANCE_FILE_MAGIC, 4);
+        hdr.version     = DISTANCE_FILE_VERSION;
+        hdr.width       = this->width;
+        hdr.height      = this->height;
+        hdr.nodes       = this->nodes;
+        hdr.reserved    = 0;
+        hdr.fingerprint = this->fingerprint;
+
+        std::vector<uint8_t> out;
+        out.reserve(sizeof(hdr) + this->table.size());
+        out.insert(out.end(), (const uint8_t*)&hdr, (const uint8_t*)&hdr + sizeof(hdr));
+
+        for(int a = 0; a < this->nodes; a++) {
+            const uint16_t* row = this->table.data() + size_t(a) * this->nodes;
+
+            int prev = 0;
+            for(int b = 0; b < this->nodes; b++) {
+                const int v = row[b] == UNREACHABLE ? 0 : row[b] + 1;
+                uint32_t z = zigzag(v - prev);
+                prev = v;
+
+                while(z >= 0x80) {
+                    out.push_back(uint8_t(z) | 0x80);
+                    z >>= 7;
+                }
+                out.push_back(uint8_t(z));
+            }
+        }
+
+        const std::string tmp = filename + ".tmp";
+
+        FILE* fp = fopen(tmp.c_str(), "wb");
+        if(fp == NULL) {
+            error = "cannot open distance table file for writing";
+            return false;
+        }
+
+        const bool ok = fwrite(out.data(), 1, out.size(), fp) == out.size();
+        if(fclose(fp) != 0 || !ok) {
+            remove(tmp.c_str());
+            error = "error writing distance table file";
+            return false;
+        }
+
+        if(rename(tmp.c_str(), filename.c_str()) != 0) {
+            remove(tmp.c_str());
+            error = "error replacing distance table file";
+            return false;
+        }
+        return true;
+    }
+
+    // reads a table saved for g. on failure the table is left empty and
+    // error says why, a table saved for some other version of the map is
+    // one of those
+    bool load(const std::string& filename, const NavGrid& g, std::string& error) {
+        this->clear();
+
+        FILE* fp = fopen(filename.c_str(), "rb");
+        if(fp == NULL) {
+            error = "cannot open distance table file";
+            return false;
+        }
+
+        std::vector<uint8_t> in;
+        uint8_t buf[1 << 16];
+        for(size_t n; (n = fread(buf, 1, sizeof(buf), fp)) > 0; )
+            in.insert(in.end(), buf, buf + n);
+        fclose(fp);
+
+        DistanceFileHeader hdr;
+        if(in.size() < sizeof(hdr)) {
+            error = "distance table file is truncated";
+            return false;
+        }
+        memcpy(&hdr, in.data(), sizeof(hdr));
+
+        if(memcmp(hdr.magic, DISTANCE_FILE_MAGIC, 4) != 0 || hdr.version != DISTANCE_FILE_VERSION) {
+            error = "not a distance table file";
+            return false;
+        }
+
+        if(hdr.width != uint32_t(g.getWidth()) || hdr.height != uint32_t(g.getHeight()) ||
+                hdr.nodes != uint32_t(g.nodeCount()) || hdr.fingerprint != fingerprintOf(g)) {
+            error = "distance table is for a different map";
+            return false;
+        }
+
+        this->loadGrid(g);
+
+        const int n = this->nodes;
+        this->table.resize(size_t(n) * n);
+
+        const uint8_t* p = in.data() + sizeof(hdr);
+        const uint8_t* end = in.data() + in.size();
+
+        for(int a = 0; a < n; a++) {
+            uint16_t* row = this->table.data() + size_t(a) * n;
+
+            int prev = 0;
+            for(int b = 0; b < n; b++) {
+                uint32_t z = 0;
+                for(int shift = 0; ; shift += 7) {
+                    if(p == end || shift > 28) {
+                        this->clear();
+                        error = "distance table file is corrupt";
+                        return false;
+                    }
+                    z |= uint32_t(*p & 0x7F) << shift;
+                    if(!(*p++ & 0x80))
+                        break;
+                }
+
+                const int v = prev + unzigzag(z);
+                if(v < 0 || v > n) {
+                    this->clear();
+                    error = "distance table file is corrupt";
+                    return false;
+                }
+                row[b] = v == 0 ? uint16_t(UNREACHABLE) : uint16_t(v - 1);
+                prev = v;
+            }
+        }
+
+        if(p != end) {
+            this->clear();
+            error = "distance table file is corrupt";
+            return false;
+        }
+        return true;
+    }
+};
+
+bool fitsDistanceTable(const TileMap& ta) {
+    const size_t cells = size_t(ta.getWidth()) * ta.getHeight();
+    return cells - ta.count(Tile_t::BARRIER) <= DistanceTable::MAX_NODES;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "nav_graph.h"
+
+// distance and direction toward one target tile for every cell of a
+// NavGrid, from a single breadth first sweep out of the target. any
+// number of agents can then walk to the target by reading their cell's
+// direction, O(1) per step, no search of their own
+class FlowField {
+    int target;
+    unsigned long version;
+    bool valid;
+
+    std::vector<int> dist;    // steps to the target, -1 if it can't be reached
+    std::vector<uint8_t> dir; // NavDir bit to move along, 0 at the target / unreachable
+    std::vector<int> queue;
+
+    static uint8_t opposite(uint8_t d) {
+        switch(d) {
+            case NavDir::NORTH: return NavDir::SOUTH;
+            case NavDir::SOUTH: return NavDir::NORTH;
+            case NavDir::EAST:  return NavDir::WEST;
+            default:            return NavDir::EAST;
+        }
+    }
+
+    void compute(const NavGrid& g) {
+        const size_t n = g.cellCount();
+        this->dist.assign(n, -1);
+        this->dir.assign(n, 0);
+        this->queue.clear();
+
+        if(this->target < 0 || size_t(this->target) >= n || !g.walkable(this->target))
+            return;
+
+        this->dist[this->target] = 0;
+        this->queue.push_back(this->target);
+
+        for(size_t head = 0; head < this->queue.size(); head++) {
+            const int i = this->queue[head];
+            const uint8_t l = g.links(i);
+
+            for(uint8_t d = 1; d <= NavDir::WEST; d <<= 1) {
+                if(!(l & d))
+                    continue;
+
+                const int j = g.step(i, d);
+                if(this->dist[j] >= 0)
+                    continue;
+
+                // j reached i by going back the way we came
+                this->dist[j] = this->dist[i] + 1;
+                this->dir[j] = opposite(d);
+                this->queue.push_back(j);
+            }
+        }
+    }
+
+public:
+    FlowField(void) : target(-1), version(0), valid(false) {}
+
+    // rebuilds the field if the target cell or the map version changed
+    // since last time. returns true if it had to
+    bool update(const NavGrid& g, int target, unsigned long map_version) {
+        if(this->valid && target == this->target && map_version == this->version)
+            return false;
+
+        this->target = target;
+        this->version = map_version;
+        this->valid = true;
+        this->compute(g);
+        return true;
+    }
+
+    // forces the next update() to rebuild
+    void invalidate(void) { this->valid = false; }
+
+    int getTarget(void) const { return this->target; }
+
+    size_t memoryUsage(void) const {
+        return (this->dist.capacity() + this->queue.capacity()) * sizeof(int) + this->dir.capacity(); }
+
+    bool reachable(int i) const { return this->dist[i] >= 0; }
+    int distance(int i) const { return this->dist[i]; }
+    uint8_t direction(int i) const { return this->dir[i]; }
+
+    // the cell to move to from i, -1 at the target or if it can't be reached
+    int next(const NavGrid& g, int i) const {
+        return this->dir[i] ? g.step(i, this->dir[i]) : -1; }
+
+    // every cell from start to the target (both included) into path.
+    // false and an empty path if the target can't be reached from start
+    bool pathFrom(const NavGrid& g, int start, std::vector<int>& path) const {
+        path.clear();
+        if(!this->reachable(start))
+            return false;
+
+        for(int i = start; i != -1; i = this->next(g, i))
+            path.push_back(i);
+        return true;
+    }
+};
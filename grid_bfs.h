@@ -0,0 +1,229 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include "tile_map.h"
+#include "nav_graph.h"
+
+// reachability over a bit-plane of walkable cells, 64 cells per word.
+// instead of a queue pop and four neighbor checks per cell, whole
+// horizontal runs of open cells are filled with a few shifts and ANDs
+// per word and then pushed into the rows above and below. gives the set
+// of cells connected to one or many sources, without distances (a
+// level at a time pass for those lost to the queue FlowField uses at
+// every map size, a single target's frontier is too thin to fill whole
+// words). 4-connected, same as NavGrid
+class GridBFS {
+    int width;
+    int height;
+    int words; // per row
+
+    std::vector<uint64_t> open; // walkable cells
+    std::vector<uint64_t> seen; // reached so far
+
+    // rows flood() still has to push outward from, and the span of
+    // words in each that gained cells since. lo > hi when it is clean
+    std::vector<int> dirty_rows;
+    std::vector<int> dirty_lo, dirty_hi;
+
+    uint64_t* row(std::vector<uint64_t>& v, int y) { return v.data() + size_t(y) * this->words; }
+    const uint64_t* row(const std::vector<uint64_t>& v, int y) const { return v.data() + size_t(y) * this->words; }
+
+    void resize(int width, int height) {
+        this->width = width;
+        this->height = height;
+        this->words = (width + 63) / 64;
+
+        const size_t n = size_t(this->words) * height;
+        this->open.assign(n, 0);
+        this->seen.assign(n, 0);
+
+        this->dirty_lo.assign(height, this->words);
+        this->dirty_hi.assign(height, -1);
+    }
+
+    // seeds within gen spread east (toward higher bits) through pro
+    static uint64_t fillEast(uint64_t gen, uint64_t pro) {
+        gen |= pro & (gen << 1);  pro &= pro << 1;
+        gen |= pro & (gen << 2);  pro &= pro << 2;
+        gen |= pro & (gen << 4);  pro &= pro << 4;
+        gen |= pro & (gen << 8);  pro &= pro << 8;
+        gen |= pro & (gen << 16); pro &= pro << 16;
+        gen |= pro & (gen << 32);
+        return gen;
+    }
+
+    static uint64_t fillWest(uint64_t gen, uint64_t pro) {
+        gen |= pro & (gen >> 1);  pro &= pro >> 1;
+        gen |= pro & (gen >> 2);  pro &= pro >> 2;
+        gen |= pro & (gen >> 4);  pro &= pro >> 4;
+        gen |= pro & (gen >> 8);  pro &= pro >> 8;
+        gen |= pro & (gen >> 16); pro &= pro >> 16;
+        gen |= pro & (gen >> 32);
+        return gen;
+    }
+
+    // fills out the runs of row y through new cells somewhere in words
+    // [wlo, whi], east then back west, carrying across words only as far
+    // as it reaches new cells. every word that might have changed goes
+    // into the row's dirty span
+    void fillRow(int y, int wlo, int whi) {
+        uint64_t* s = this->row(this->seen, y);
+        const uint64_t* o = this->row(this->open, y);
+
+        int w = wlo;
+        uint64_t carry = 0;
+        for(; w < this->words; w++) {
+            if(w > whi && !(carry & o[w] & ~s[w] & 1))
+                break;
+            s[w] = fillEast(s[w] | (carry & o[w] & 1), o[w]);
+            carry = s[w] >> 63;
+        }
+        const int east = w - 1;
+
+        carry = 0;
+        for(w = east; w >= 0; w--) {
+            if(w < wlo && !((carry << 63) & o[w] & ~s[w]))
+                break;
+            s[w] = fillWest(s[w] | (carry << 63 & o[w]), o[w]);
+            carry = s[w] & 1;
+        }
+
+        this->dirty_lo[y] = std::min(this->dirty_lo[y], w + 1);
+        this->dirty_hi[y] = std::max(this->dirty_hi[y], east);
+    }
+
+    // pulls cells row from reached within words [wlo, whi] into row y and
+    // fills them out. true if y gained anything
+    bool pullRow(int y, int from, int wlo, int whi) {
+        uint64_t* s = this->row(this->seen, y);
+        const uint64_t* o = this->row(this->open, y);
+        const uint64_t* f = this->row(this->seen, from);
+
+        int lo = whi + 1, hi = wlo - 1;
+        for(int w = wlo; w <= whi; w++) {
+            const uint64_t add = f[w] & o[w] & ~s[w];
+            if(add) {
+                s[w] |= add;
+                lo = std::min(lo, w);
+                hi = w;
+            }
+        }
+
+        if(lo > hi)
+            return false;
+
+        this->fillRow(y, lo, hi);
+        return true;
+    }
+
+public:
+    GridBFS(void) : width(0), height(0), words(0) {}
+
+    // walkable cells are the NavGrid's nodes
+    void load(const NavGrid& g) {
+        this->resize(g.getWidth(), g.getHeight());
+
+        for(int y = 0; y < this->height; y++) {
+            uint64_t* o = this->row(this->open, y);
+            for(int x = 0; x < this->width; x++)
+                if(g.walkable(g.index(y, x)))
+                    o[x >> 6] |= uint64_t(1) << (x & 63);
+        }
+    }
+
+    // walkable cells are the non-barrier tiles. tile map words line up
+    // with ours so this is one NOT per 64 tiles
+    void load(const TileMap& ta) {
+        this->resize(ta.getWidth(), ta.getHeight());
+
+        const int tail = this->width & 63;
+        const uint64_t last = tail ? (uint64_t(1) << tail) - 1 : ~uint64_t(0);
+
+        for(int y = 0; y < this->height; y++) {
+            uint64_t* o = this->row(this->open, y);
+            for(int w = 0; w < this->words; w++)
+                o[w] = ~uint64_t(ta.barrierWord(y, w)) & (w + 1 == this->words ? last : ~uint64_t(0));
+        }
+    }
+
+    int getWidth(void) const { return this->width; }
+    int getHeight(void) const { return this->height; }
+
+    size_t memoryUsage(void) const {
+        return (this->open.capacity() + this->seen.capacity()) * sizeof(uint64_t) +
+            (this->dirty_rows.capacity() + this->dirty_lo.capacity() + this->dirty_hi.capacity()) * sizeof(int);
+    }
+
+    // every cell connected to a source cell (y*width+x). fills whole
+    // horizontal runs of open cells in one go, and every row that gained
+    // cells pushes them into the rows above and below until nothing new
+    // is reached. open areas
+    // and long corridors take a pass or two per row rather than one per
+    // step, and a maze only revisits the words a turn actually touched.
+    // reached() etc. see the result
+    size_t flood(const int* sources, int count) {
+        std::fill(this->seen.begin(), this->seen.end(), 0);
+        this->dirty_rows.clear();
+
+        for(int k = 0; k < count; k++) {
+            const int i = sources[k];
+            if(i < 0 || i >= this->width * this->height)
+                continue;
+
+            const int y = i / this->width;
+            const int x = i % this->width;
+            const uint64_t bit = this->row(this->open, y)[x >> 6] & (uint64_t(1) << (x & 63));
+            if(!bit)
+                continue;
+
+            this->row(this->seen, y)[x >> 6] |= bit;
+            if(this->dirty_lo[y] > this->dirty_hi[y])
+                this->dirty_rows.push_back(y);
+            this->fillRow(y, x >> 6, x >> 6);
+        }
+
+        // a row that gained cells pushes them up and down, which might
+        // make those rows dirty in turn
+        while(!this->dirty_rows.empty()) {
+            const int y = this->dirty_rows.back();
+            this->dirty_rows.pop_back();
+
+            const int wlo = this->dirty_lo[y];
+            const int whi = this->dirty_hi[y];
+            this->dirty_lo[y] = this->words;
+            this->dirty_hi[y] = -1;
+
+            for(int ny = y - 1; ny <= y + 1; ny += 2) {
+                if(ny < 0 || ny >= this->height)
+                    continue;
+
+                const bool queued = this->dirty_lo[ny] <= this->dirty_hi[ny];
+                if(this->pullRow(ny, y, wlo, whi) && !queued)
+                    this->dirty_rows.push_back(ny);
+            }
+        }
+
+        return this->reachedCount();
+    }
+
+    size_t flood(int source) { return this->flood(&source, 1); }
+
+    // whether the last flood reached (y, x)
+    bool reached(int y, int x) const {
+        return (this->row(this->seen, y)[x >> 6] >> (x & 63)) & 1; }
+
+    // reached cells of row y from the last flood, 64 per word
+    const uint64_t* reachedRow(int y) const { return this->row(this->seen, y); }
+    int wordsPerRow(void) const { return this->words; }
+
+    // number of cells the last flood reached
+    size_t reachedCount(void) const {
+        size_t n = 0;
+        for(uint64_t w : this->seen)
+            n += __builtin_popcountll(w);
+        return n;
+    }
+};
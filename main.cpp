@@ -4,39 +4,42 @@
 #include <string>
 #include <SDL/SDL.h>
 #include "event_core.h"
+#include "map_format.h"
+#include "tile_map.h"
+#include "collision.h"
+#include "map_io.h"
+#include "dirty_regions.h"
+#include "tile_sprites.h"
 #include "main.h"
+#include "nav_graph.h"
+#include "flow_field.h"
+#include "nav_components.h"
+#include "batch.h"
+#include "autosave.h"
 
 using namespace std;
 
 #define TILEWIDTH 24
 
-struct Tile_t {
-    int type;
-    int tracked;
+// how many tiles fit on screen at once
+#define VIEW_TILES_X 25
+#define VIEW_TILES_Y 25
 
-    static const int DEFAULT     = 0;
-    static const int BARRIER     = 1;
-    static const int SPAWN_POINT = 2;
-};
+// seconds between autosaves of an edited map
+#define AUTOSAVE_INTERVAL 60
 
-typedef vector<vector<Tile_t>> TileArray_t;
+// SDL_UserEvent codes
+#define EVENT_AUTOSAVE 1
 
-// we want to have as few of these as possible for a given map
-struct CollisionGeometry {    
-    // basically just a SDL_Rect but with larger data type
-    int x;
-    int y;
-    int w;
-    int h;
-};
+typedef TileMap TileArray_t;
 
-void initTileArray(TileArray_t& ta);
-void render(SDL_Surface* scr, TileArray_t& ta, bool render_collision_data);
-void saveFile(std::string filename, TileArray_t& ta);
-void readFile(std::string filename, TileArray_t& ta);
-void renderAiData(SDL_Surface* scr, TileArray_t& ta, int y, int x);
-
-vector<CollisionGeometry> optimize_collision_entities(TileArray_t& ta);
+void initTileArray(LayeredTileMap& lm, int width, int height, int depth);
+void render(
+        SDL_Surface* scr, TileArray_t& ta, bool render_collision_data, const CollisionSet& cs,
+        const vector<pair<int,int>>& ai_path, int view_y, int view_x,
+        const DirtyRegions& dirty, TileSpriteCache& sprites);
+bool readFile(std::string filename, LayeredTileMap& lm);
+vector<pair<int,int>> findAiPaths(const TileArray_t& ta, const NavGrid& nav, const FlowField& flow);
 
 int main(int argc, char* argv[]) {
 
@@ -45,42 +48,97 @@ int main(int argc, char* argv[]) {
         cout << 
             " -n <new map file>\n"
             " -i <existing map file>\n"
-            " -o <where to save map file>\n\n";
+            " -o <where to save map file>\n"
+            " -s <width>x<height>[x<layers>] (size of a new map, default 25x25x1)\n"
+            " -a <seconds> (autosave interval, 0 turns it off, default 60)\n\n"
+            "headless batch mode (no window):\n\n"
+            " -b <map file, directory or glob> (may be given more than once)\n"
+            " -f text|binary (output format, default is the input format)\n"
+            " -d <output directory>\n"
+            " --in-place (no -d, write each map next to its input, overwriting it if the format stays)\n"
+            " --no-dist (don't write a distance table next to each small map)\n"
+            " -j <threads> (default is every core)\n\n"
+            "map files ending in " LEVEL_BINARY_EXTENSION " are read and written in the binary level format\n"
+            "page up/down switches between layers, page up on the top layer adds a new one\n\n";
 
         return 1;
     }
 
-    // each tile is 24x24 pixels
-    TileArray_t tile_array;
-    initTileArray(tile_array);
+    // each tile is 24x24 pixels. the editor works on one layer at a time
+    LayeredTileMap level;
+    int layer = 0;
 
     string infile, outfile;
+    int map_width = LEVEL_DEFAULT_WIDTH, map_height = LEVEL_DEFAULT_HEIGHT, map_depth = 1;
+    int autosave_interval = AUTOSAVE_INTERVAL;
 
-    string flag = argv[1];
-    if(flag == "-n") {
-        outfile = argv[2];
-    }
-    else if(flag == "-i") {
-        infile = argv[2];
-        ::readFile(infile, tile_array);
-    }
-    else if(flag == "-o") {
-        outfile = argv[2];
-    }
+    BatchOptions batch;
+
+    for(int i = 1; i < argc; i++) {
+        string flag = argv[i];
+
+        // switches, everything else takes a value
+        if(flag == "--in-place") {
+            batch.in_place = true;
+            continue;
+        }
+        else if(flag == "--no-dist") {
+            batch.distances = false;
+            continue;
+        }
+
+        if(i + 1 >= argc)
+            break;
 
-    if(argc >= 5) {
-        flag = argv[3];
-        if(flag == "-i") {
-            infile = argv[4];
-            ::readFile(infile, tile_array);
+        if(flag == "-n" || flag == "-o") {
+            outfile = argv[i+1];
         }
-        else if(flag == "-o") {
-            outfile = argv[4];
+        else if(flag == "-i") {
+            infile = argv[i+1];
         }
+        else if(flag == "-s") {
+            int n = sscanf(argv[i+1], "%dx%dx%d", &map_width, &map_height, &map_depth);
+            if(n < 2 || map_width <= 0 || map_height <= 0 || map_depth <= 0) {
+                cout << "invalid map size: " << argv[i+1] << endl;
+                return 1;
+            }
+        }
+        else if(flag == "-a") {
+            autosave_interval = atoi(argv[i+1]);
+        }
+        else if(flag == "-b") {
+            batch.inputs.push_back(argv[i+1]);
+        }
+        else if(flag == "-f") {
+            batch.format = argv[i+1];
+        }
+        else if(flag == "-d") {
+            batch.outdir = argv[i+1];
+        }
+        else if(flag == "-j") {
+            batch.threads = atoi(argv[i+1]);
+        }
+        i++;
     }
 
+    // batch mode never opens a window
+    if(!batch.inputs.empty())
+        return batch_run(batch);
+
+    initTileArray(level, map_width, map_height, map_depth);
+    if(!infile.empty() && !::readFile(infile, level))
+        return 1;
+
+    // collision rectangles of the layer being edited are kept up to date
+    // as tiles get edited. a single layer map is saved with them, saving
+    // one with more layers merges all of them into boxes
+    CollisionSet collision_set;
+    collision_set.rebuild(level.layer(layer), CollisionMode::RECTANGLES);
+
     SDL_Init(SDL_INIT_EVERYTHING);
-    auto* scr = SDL_SetVideoMode(800, 600, 32, SDL_HWSURFACE | SDL_DOUBLEBUF | SDL_FULLSCREEN);
+    // single-buffered software surface so SDL_UpdateRects can push just
+    // the parts of the screen that changed
+    auto* scr = SDL_SetVideoMode(800, 600, 32, SDL_SWSURFACE | SDL_FULLSCREEN);
 
 /*
     for(int y : {0, 24})
@@ -97,330 +155,393 @@ int main(int argc, char* argv[]) {
 
     int tile_x = 0, tile_y = 0;
 
+    // top-left tile of the visible part of the map
+    int view_x = 0, view_y = 0;
+
+    // only changed tiles get redrawn, the first frame redraws everything
+    DirtyRegions dirty(VIEW_TILES_Y, VIEW_TILES_X, TILEWIDTH, 800, 600);
+    TileSpriteCache sprites(TILEWIDTH);
+
+    // saving happens on a worker thread so the editor never waits on the disk.
+    // map_version counts edits, autosaves are skipped if nothing changed
+    AutoSaver saver;
+    unsigned long map_version = 0, autosaved_version = 0;
+
+    SDL_TimerID autosave_timer = NULL;
+    if(autosave_interval > 0 && !outfile.empty()) {
+        autosave_timer = SDL_AddTimer(autosave_interval * 1000, [](Uint32 interval, void*) -> Uint32 {
+            // timer callbacks run on their own thread, hand off to the event loop
+            SDL_Event ev;
+            ev.type = SDL_USEREVENT;
+            ev.user.code = EVENT_AUTOSAVE;
+            ev.user.data1 = NULL;
+            ev.user.data2 = NULL;
+            SDL_PushEvent(&ev);
+            return interval;
+        }, NULL);
+    }
+
+    // tiles covered by the ai paths currently on screen
+    vector<pair<int,int>> ai_path;
+    bool ai_stale = true;
+
+    // navigation graph of the ground floor and its connected regions (used
+    // to warn about spawn points that can't reach each other when saving).
+    // both are dense, ~9 bytes per tile no matter how empty the map is, so
+    // they are only built the first time a path or a reachability check
+    // needs them and patched as tiles get toggled after that.
+    // nav_version counts the changes to them
+    NavGrid nav;
+    NavComponents nav_regions;
+    bool nav_built = false;
+    unsigned long nav_version = 0;
+
+    // false if the map is too big to have a NavGrid at all
+    auto nav_ready = [&level, &nav, &nav_regions, &nav_built]() {
+        const TileMap& ground = level.layer(0);
+        if(!NavGrid::fits(ground.getWidth(), ground.getHeight()))
+            return false;
+
+        if(!nav_built) {
+            nav.build(ground);
+            nav_regions.build(nav);
+            nav_built = true;
+        }
+        return true;
+    };
+
+    // every spawn point walks the same flow field toward the cursor. it is
+    // only recomputed when the cursor moves to another tile or the graph changes
+    FlowField flow;
+
     sdl_event_map_t eventmap = {
         {
             SDL_KEYDOWN,
             [
                     &loop_running,&outfile,
-                    &tile_array,&render_collision_data,
-                    &render_ai_data](void* ptr) {
+                    &level,&layer,&render_collision_data,
+                    &render_ai_data,&view_x,&view_y,&collision_set,
+                    &dirty,&ai_path,&ai_stale,&saver,&map_version,&nav,&nav_regions,&nav_ready](void* ptr) {
 
                 auto* key_event = (SDL_KeyboardEvent*)ptr;
                 auto sym = key_event->keysym.sym;
 
+                TileArray_t& tile_array = level.layer(layer);
+
                 if(sym == SDLK_ESCAPE)
                     loop_running = false;
-                else if(sym == SDLK_s)
-                    ::saveFile(outfile, tile_array);
-                else if(sym == SDLK_q)
+                else if(sym == SDLK_s) {
+                    if(outfile.empty())
+                        cout << "no output file given, use -o\n";
+                    else {
+                        saver.save(level, outfile, collision_set, true);
+
+                        // a single spawn point can't be cut off from anything
+                        vector<pair<int,int>> stranded;
+                        if(level.layer(0).count(Tile_t::SPAWN_POINT) > 1 && nav_ready()) {
+                            const int first = find_unreachable_spawns(level.layer(0), nav, nav_regions, stranded);
+                            for(auto& p : stranded)
+                                cout << "warning: spawn point (" << p.first << ", " << p.second << ") cannot reach ("
+                                     << nav.cellY(first) << ", " << nav.cellX(first) << ")\n";
+                        }
+                    }
+                }
+                else
+                    dirty.markAll(); // everything else changes what is on screen
+
+                if(sym == SDLK_q)
                     render_collision_data = !render_collision_data;
-                else if(sym == SDLK_w)
+                else if(sym == SDLK_w) {
                     render_ai_data = !render_ai_data;
+                    ai_path.clear();
+                    ai_stale = true;
+                }
+                else if(sym == SDLK_r)
+                    collision_set.rebuild(tile_array, (collision_set.getMode() == CollisionMode::RECTANGLES) ?
+                        CollisionMode::RUNS : CollisionMode::RECTANGLES);
+                else if(sym == SDLK_LEFT)
+                    view_x = max(view_x - 1, 0);
+                else if(sym == SDLK_RIGHT)
+                    view_x = max(min(view_x + 1, tile_array.getWidth() - VIEW_TILES_X), 0);
+                else if(sym == SDLK_UP)
+                    view_y = max(view_y - 1, 0);
+                else if(sym == SDLK_DOWN)
+                    view_y = max(min(view_y + 1, tile_array.getHeight() - VIEW_TILES_Y), 0);
+                else if(sym == SDLK_PAGEUP || sym == SDLK_PAGEDOWN) {
+                    if(sym == SDLK_PAGEUP) {
+                        if(layer + 1 == level.getDepth()) {
+                            level.pushLayer();
+                            map_version++;
+                        }
+                        layer++;
+                    }
+                    else if(layer > 0) {
+                        // an empty top layer that was just left goes away again
+                        if(layer + 1 == level.getDepth() && level.layer(layer).chunkCount() == 0) {
+                            level.popLayer();
+                            map_version++;
+                        }
+                        layer--;
+                    }
+
+                    collision_set.rebuild(level.layer(layer), collision_set.getMode());
+                    cout << "layer " << layer << " of " << level.getDepth() << endl;
+                }
 
             }
         },
         {
             SDL_MOUSEBUTTONDOWN,
-            [&tile_array, &tile_x, &tile_y](void* ptr) {
+            [
+                    &level, &layer, &collision_set, &tile_x, &tile_y, &view_x, &view_y,
+                    &dirty, &ai_stale, &map_version, &nav, &nav_version, &nav_regions, &nav_built](void* ptr) {
                 auto* mouse_button_event = (SDL_MouseButtonEvent*)ptr;
-                auto x = mouse_button_event->x;
-                auto y = mouse_button_event->y;
+                TileArray_t& tile_array = level.layer(layer);
+                int x = mouse_button_event->x;
+                int y = mouse_button_event->y;
 
                 x /= TILEWIDTH;
                 y /= TILEWIDTH;
 
-                if(x > 24)
+                if(x >= VIEW_TILES_X)
+                    return;
+
+                x += view_x;
+                y += view_y;
+
+                if(!tile_array.inBounds(y, x))
                     return;
 
                 tile_x = x;
                 tile_y = y;
 
-                Tile_t& tref = tile_array[y][x];
+                int type = tile_array.get(y, x);
 
                 if(mouse_button_event->button == SDL_BUTTON_LEFT) {
 
-                    if(tref.type != Tile_t::BARRIER)
-                        tref.type = Tile_t::BARRIER;
+                    if(type != Tile_t::BARRIER)
+                        tile_array.set(y, x, Tile_t::BARRIER);
                     else
-                        tref.type = Tile_t::DEFAULT;
+                        tile_array.set(y, x, Tile_t::DEFAULT);
                 
                 }
                 else if(mouse_button_event->button == SDL_BUTTON_RIGHT) {
 
-                    if(tref.type != Tile_t::SPAWN_POINT)
-                        tref.type = Tile_t::SPAWN_POINT;
+                    if(type != Tile_t::SPAWN_POINT)
+                        tile_array.set(y, x, Tile_t::SPAWN_POINT);
                     else
-                        tref.type = Tile_t::DEFAULT;
+                        tile_array.set(y, x, Tile_t::DEFAULT);
                     
                 }
+
+                // ai only walks the ground floor, relink just this node
+                const int new_type = tile_array.get(y, x);
+                if(nav_built && layer == 0 && (type == Tile_t::BARRIER) != (new_type == Tile_t::BARRIER)) {
+                    nav.updateTile(y, x, new_type);
+                    nav_regions.tileChanged(nav, y, x);
+                    nav_version++;
+                }
+
+                // patch only the rectangles around this tile
+                auto touched = collision_set.update(tile_array, y, x, type == Tile_t::BARRIER);
+
+                // the tile itself plus any collision overlay that moved
+                dirty.markTile(y - view_y, x - view_x);
+                dirty.markArea(touched.y - view_y, touched.x - view_x, touched.h, touched.w);
+                ai_stale = true;
+                map_version++;
             }
         },
         {
             SDL_MOUSEMOTION,
-            [&tile_x, &tile_y](void* ptr) {
+            [&tile_x, &tile_y, &view_x, &view_y, &ai_stale](void* ptr) {
                 auto* mouse_motion_event = (SDL_MouseMotionEvent*)ptr;
-                auto x = mouse_motion_event->x;
-                auto y = mouse_motion_event->y;
+                int x = mouse_motion_event->x / TILEWIDTH + view_x;
+                int y = mouse_motion_event->y / TILEWIDTH + view_y;
+
+                // nothing on screen depends on the cursor except the ai paths
+                if(x != tile_x || y != tile_y)
+                    ai_stale = true;
+
+                tile_x = x;
+                tile_y = y;
+            }
+        },
+        {
+            SDL_USEREVENT,
+            [&level, &collision_set, &outfile, &saver, &map_version, &autosaved_version](void* ptr) {
+                auto* user_event = (SDL_UserEvent*)ptr;
 
-                tile_x = x / TILEWIDTH;
-                tile_y = y / TILEWIDTH;
+                if(user_event->code == EVENT_AUTOSAVE && map_version != autosaved_version) {
+                    saver.save(level, autosaveFileName(outfile), collision_set);
+                    autosaved_version = map_version;
+                }
+            }
+        },
+        {
+            SDL_VIDEOEXPOSE,
+            [&dirty](void*) {
+                dirty.markAll();
+            }
+        },
+        {
+            SDL_ACTIVEEVENT,
+            [&dirty](void*) {
+                dirty.markAll();
             }
         }
     };
 
     while(loop_running) {
-        sdl_evaluate_events(eventmap);
-        render(scr, tile_array, render_collision_data);
-        if(render_ai_data)
-            renderAiData(scr, tile_array, tile_y, tile_x);
 
-        SDL_Flip(scr);
-        SDL_Delay(16);
-    }
-
-    SDL_Quit();
-    return 0;
-}
-
-vector<CollisionGeometry> optimize_collision_entities(TileArray_t& ta) {
-
-    //cout << "optimizing collision geometry...\n" << flush;
-
-    vector<CollisionGeometry> vcollide;
-
-    auto track_h = [&ta](int y, int x) -> int {
-
-        //cout << "tracking h-length(x=" << x << ",y=" << y << ")...\n" << flush;
-
-        int len = 0;
-        while(x < 25 && ta[y][x].type == Tile_t::BARRIER) {
-            len++;
-            x++;
-        }
-
-        return len;
-    };
-
-    auto track_v = [&ta](int y, int x) -> int {
+        // nothing left to redraw, sleep until something happens
+        if(dirty.empty() && !(render_ai_data && ai_stale))
+            sdl_wait_events(eventmap);
+        else
+            sdl_evaluate_events(eventmap);
+
+        if(render_ai_data && ai_stale) {
+            // ai only walks the ground floor
+            vector<pair<int,int>> path;
+            if(level.layer(0).inBounds(tile_y, tile_x) && nav_ready()) {
+                flow.update(nav, nav.index(tile_y, tile_x), nav_version);
+                path = findAiPaths(level.layer(0), nav, flow);
+            }
 
-        //cout << "tracking v-length(x=" << x << ",y=" << y << ")...\n" << flush;
+            // erase the old paths and draw the new ones
+            for(auto& p : ai_path)
+                dirty.markTile(p.first - view_y, p.second - view_x);
+            for(auto& p : path)
+                dirty.markTile(p.first - view_y, p.second - view_x);
 
-        int len = 0;
-        while(y < 25 && ta[y][x].type == Tile_t::BARRIER) {
-            len++;
-            y++;
+            ai_path.swap(path);
         }
+        ai_stale = false;
 
-        return len;
-    };
-
-    for(int y = 0; y < 25; y++) {
-        for(int x = 0; x < 25; x++) {
-
-            if(ta[y][x].type == Tile_t::BARRIER && ta[y][x].tracked == 0) {
-
-                CollisionGeometry cg;
-                cg.x = x;
-                cg.y = y;
-
-                int hlen = track_h(y, x);
-                int vlen = track_v(y, x);
-
-                if(hlen >= vlen) {
-                    // equal length favors hlen
-                    for(int i = 0; i < hlen; i++)
-                        ta[y][x+i].tracked++;
-                
-                    cg.h = 1;
-                    cg.w = hlen;
-
-                }
-                else {
-
-                    for(int i = 0; i < vlen; i++)
-                        ta[y+i][x].tracked++;
+        if(dirty.empty())
+            continue;
 
-                    cg.h = vlen;
-                    cg.w = 1;
+        render(scr, level.layer(layer), render_collision_data, collision_set, ai_path, view_y, view_x, dirty, sprites);
 
-                }
-
-                vcollide.push_back(cg);
-            }
-        }
+        auto spans = dirty.spans();
+        SDL_UpdateRects(scr, spans.size(), spans.data());
+        dirty.clear();
     }
 
-    // reset all tracking data
-    for(int y = 0; y < 25; y++)
-        for(int x = 0; x < 25; x++)
-            ta[y][x].tracked = 0;
-
-    return vcollide;
-}
+    if(autosave_timer)
+        SDL_RemoveTimer(autosave_timer);
 
-void saveFile(std::string filename, TileArray_t& ta) {
-    ofstream os(filename);
-    
-    os << "MAPDATA\n";
+    if(!saver.idle())
+        cout << "waiting for saves to finish...\n" << flush;
 
-    for(int y = 0; y < 25; y++) {
-        for(int x = 0; x < 25; x++) {
-            os << ta[y][x].type << ' ';
-        }
-        os << '\n';
-    }
-
-    auto vcollide = optimize_collision_entities(ta);
+    SDL_Quit();
+    return 0;
+}
 
-    os << vcollide.size() << '\n';
-    for(auto cg : vcollide) {
-        os << cg.x << ' ' << cg.y << ' ' << cg.h << ' ' << cg.w << '\n';
+bool readFile(std::string filename, LayeredTileMap& lm) {
+    string error;
+    if(!loadMap(filename, lm, error)) {
+        cout << filename << ": " << error << endl;
+        return false;
     }
+    return true;
+}
 
-    os.close();
+void initTileArray(LayeredTileMap& lm, int width, int height, int depth) {
+    // every tile starts out DEFAULT, which costs nothing until it is edited
+    lm.reset(width, height, depth);
 }
 
-void readFile(std::string filename, TileArray_t& ta) {
-    ifstream is(filename);
-    string token;
+vector<pair<int,int>> findAiPaths(const TileArray_t& ta, const NavGrid& nav, const FlowField& flow) {
 
-    if(!(is >> token)) {
-        cout << "map file is empty...\n";
-        exit(1);
-    }
+    std::vector<std::pair<int,int>> tiles;
+    std::vector<int> cells;
 
-    for(int y = 0; y < 25; y++) {
-        for(int x = 0; x < 25; x++) {
+    // one lookup per step from each spawn point, no searching
+    ta.forEachTile([&](int y, int x, int type) {
+        if(type != Tile_t::SPAWN_POINT || !flow.pathFrom(nav, nav.index(y, x), cells))
+            return;
 
-            is >> token;
-
-            if(token == "0") {
-                ta[y][x].type = Tile_t::DEFAULT;
-            }
-            else if(token == "1") {
-                ta[y][x].type = Tile_t::BARRIER;
-            }
-            else if(token == "2") {
-                ta[y][x].type = Tile_t::SPAWN_POINT;
-            }
-            else {
-                cout << "map contains invalid data: " << token << endl;
-                exit(1);
-            }
-
-        }
-    }
+        for(int i : cells)
+            tiles.push_back({ nav.cellY(i), nav.cellX(i) });
+    });
 
+    return tiles;
 }
 
-void initTileArray(TileArray_t& ta) {
-    for(int y = 0; y < 25; y++) {
-        ta.push_back({}); // push back empty vector<Tile_t>
+void render(
+        SDL_Surface* scr, TileArray_t& ta, bool render_collision_data, const CollisionSet& cs,
+        const vector<pair<int,int>>& ai_path, int view_y, int view_x,
+        const DirtyRegions& dirty, TileSpriteCache& sprites) {
 
-        for(int x = 0; x < 25; x++) {
-            ta.back().push_back({}); // push back empty Tile_t
-            ta.back().back().type = Tile_t::DEFAULT;
-            ta.back().back().tracked = 0;
-        }
-    }
-}
+    auto spans = dirty.spans();
 
-void renderAiData(SDL_Surface* scr, TileArray_t& ta, int y, int x) {
+    // tiles cover their whole cell, only a full redraw has to clear the
+    // parts of the screen that are not covered by the map
+    if(dirty.isFull())
+        SDL_FillRect(scr, NULL, 0x00);
 
-    Graph g;
-    std::vector<std::pair<int,int>> pts;
+    // which on-screen tiles have the ai path drawn over them
+    vector<uint8_t> overlay_mask(VIEW_TILES_Y * VIEW_TILES_X, TileOverlay::NONE);
+    for(auto p : ai_path) {
+        p.first  -= view_y;
+        p.second -= view_x;
 
-    // insert nodes into Graph
-    for(int y = 0; y < 25; y++) {
-        for(int x = 0; x < 25; x++) {
-            if(ta[y][x].type != Tile_t::BARRIER) {
-                g.insertNewNode(y, x);
-    
-                // spawn points are special
-                if(ta[y][x].type == Tile_t::SPAWN_POINT)
-                    pts.push_back({ y, x });
-            }
-        }
+        if(p.first >= 0 && p.second >= 0 && p.first < VIEW_TILES_Y && p.second < VIEW_TILES_X)
+            overlay_mask[p.first * VIEW_TILES_X + p.second] = TileOverlay::PATH;
     }
 
-    for(auto& p : pts) {
-        auto v = g.searchFor(p, { y, x });
-        
-        if(v)
-            for(auto r : *v) {
+    // only the visible window of the map gets drawn
+    const int rows = min(VIEW_TILES_Y, ta.getHeight() - view_y);
+    const int cols = min(VIEW_TILES_X, ta.getWidth() - view_x);
 
-                SDL_Rect rect;
-                rect.x = TILEWIDTH * r.second;
-                rect.y = TILEWIDTH * r.first;
+    for(int y = 0; y < VIEW_TILES_Y; y++) {
+        for(int x = 0; x < VIEW_TILES_X; x++) {
 
-                rect.h = 24;
-                rect.w = 24;
+            if(!dirty.isDirty(y, x))
+                continue;
 
-                SDL_FillRect(scr, &rect, SDL_MapRGB(scr->format, 0x00, 0x00, 0x00));
+            if(y >= rows || x >= cols) {
+                // past the edge of the map
+                SDL_Rect r;
+                r.x = TILEWIDTH * x;
+                r.y = TILEWIDTH * y;
+                r.h = TILEWIDTH;
+                r.w = TILEWIDTH;
+                SDL_FillRect(scr, &r, 0x00);
+                continue;
             }
-    }
-}
-
-void render(SDL_Surface* scr, TileArray_t& ta, bool render_collision_data) {
-
-    // clear the screen
-    SDL_FillRect(scr, NULL, 0x00);
 
-    for(int y = 0; y < 25; y++) {
-        for(int x = 0; x < 25; x++) {
+            sprites.blit(
+                scr, ta.get(y + view_y, x + view_x), overlay_mask[y * VIEW_TILES_X + x],
+                TILEWIDTH * x, TILEWIDTH * y);
+        }
+    }
 
-            Tile_t t = ta[y][x];
-            //t.type = Tile_t::BARRIER;
+    if(render_collision_data) {
 
-            SDL_Rect r;
-            r.x = TILEWIDTH * x + 2;
-            r.y = TILEWIDTH * y + 2;
-            r.h = TILEWIDTH - 4;
-            r.w = TILEWIDTH - 4;
+        // overlay rectangles that are at least partly on screen
+        vector<SDL_Rect> overlay;
 
-            if(t.type == Tile_t::DEFAULT) {
+        cs.forEach([&](CollisionGeometry cg) {
 
-                SDL_FillRect(scr, &r, SDL_MapRGB(scr->format, 80, 80, 80));
+            cg.x -= view_x;
+            cg.y -= view_y;
 
-            }
-            else if(t.type == Tile_t::BARRIER) {
-
-                SDL_FillRect(scr, &r, SDL_MapRGB(scr->format, 220, 0, 0));
-                r.y += 6;
-                r.h = 1;
-                SDL_FillRect(scr, &r, SDL_MapRGB(scr->format, 255, 255, 255));
-                r.y += 8;
-                SDL_FillRect(scr, &r, SDL_MapRGB(scr->format, 255, 255, 255));
-                r.y -= 8;
-                r.h = 8;
-                r.w = 1;
-                r.x += 4;
-                SDL_FillRect(scr, &r, SDL_MapRGB(scr->format, 255, 255, 255));
-                r.h = 8;
-                r.w = 1;
-                r.x += 12;
-                SDL_FillRect(scr, &r, SDL_MapRGB(scr->format, 255, 255, 255));
-                r.x -= 6;
-                r.y -= 6;
-                r.h -= 1;
-                SDL_FillRect(scr, &r, SDL_MapRGB(scr->format, 255, 255, 255));
-                r.y += 14;
-                SDL_FillRect(scr, &r, SDL_MapRGB(scr->format, 255, 255, 255));
+            // skip anything outside the visible window
+            if(cg.x >= VIEW_TILES_X || cg.y >= VIEW_TILES_Y || cg.x + cg.w <= 0 || cg.y + cg.h <= 0)
+                return;
 
-            }
-            else if(t.type == Tile_t::SPAWN_POINT) {
+            bool horizontal = (cg.h == 1);
+            bool vertical   = (cg.w == 1);
 
-                SDL_FillRect(scr, &r, SDL_MapRGB(scr->format, 0, 255, 255));
+            // clip the rest so the pixel coordinates fit in an SDL_Rect
+            if(cg.x < 0) { cg.w += cg.x; cg.x = 0; }
+            if(cg.y < 0) { cg.h += cg.y; cg.y = 0; }
+            cg.w = min(cg.w, VIEW_TILES_X - cg.x);
+            cg.h = min(cg.h, VIEW_TILES_Y - cg.y);
 
-            }
-        }
-    }
-
-    if(render_collision_data) {
-        auto vcollide = optimize_collision_entities(ta);
-        for(auto cg : vcollide) {
-
-            if(cg.h == 1) {
+            if(horizontal) {
 
                 // horizontal entity
                 SDL_Rect r;
@@ -429,10 +550,10 @@ void render(SDL_Surface* scr, TileArray_t& ta, bool render_collision_data) {
                 r.h = 12;
                 r.w = cg.w * TILEWIDTH;
             
-                SDL_FillRect(scr, &r, SDL_MapRGB(scr->format, 255, 255, 0));
+                overlay.push_back(r);
 
             }
-            else {
+            else if(vertical) {
 
                 // vertical entity
                 SDL_Rect r;
@@ -441,11 +562,40 @@ void render(SDL_Surface* scr, TileArray_t& ta, bool render_collision_data) {
                 r.h = cg.h * TILEWIDTH;
                 r.w = 12;
 
-                SDL_FillRect(scr, &r, SDL_MapRGB(scr->format, 255, 255, 0));
+                overlay.push_back(r);
 
             }
+            else {
+
+                // full rectangle, inset the same as the thin ones
+                SDL_Rect r;
+                r.x = TILEWIDTH*cg.x + 6;
+                r.y = TILEWIDTH*cg.y + 6;
+                r.h = cg.h * TILEWIDTH - 12;
+                r.w = cg.w * TILEWIDTH - 12;
+
+                overlay.push_back(r);
 
+            }
+
+        });
+
+        // redraw the overlay only inside the dirty spans
+        const Uint32 yellow = SDL_MapRGB(scr->format, 255, 255, 0);
+
+        for(auto& s : spans) {
+            SDL_SetClipRect(scr, &s);
+
+            for(auto& r : overlay) {
+                if(r.x >= s.x + s.w || r.y >= s.y + s.h || r.x + r.w <= s.x || r.y + r.h <= s.y)
+                    continue;
+
+                SDL_Rect tmp = r; // SDL_FillRect clips its argument
+                SDL_FillRect(scr, &tmp, yellow);
+            }
         }
+
+        SDL_SetClipRect(scr, NULL);
     }
 
 }
@@ -0,0 +1,460 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/*
+    binary level format. lives alongside the MAPDATA text format, the
+    loaders sniff the magic number and pick whichever one they got.
+    everything is stored little-endian (whatever the host is, really) and
+    laid out so the file can be mmap'd and read in place:
+
+        LevelFileHeader          32 bytes
+        tile planes              layers*width*height bytes, one width*height plane
+                                 per layer (ground floor first), row-major,
+                                 one tile type per byte
+        (padding to 4 bytes)
+        collision table          collision_count * LevelFileBox
+                                 (LevelFileRect in version 1 files)
+
+    files ending in LEVEL_BINARY_EXTENSION are written in this format.
+    version 1 files have a single layer and 2D rectangles, they are still read.
+
+    text maps start with a 'MAPDATA <width> <height> [<layers>]' line followed
+    by the layers one after another. a bare 'MAPDATA' line is the original
+    fixed 25x25 layout and is still accepted. single layer maps list their
+    collision rectangles as 'x y h w', layered ones as 'x y h w z d'
+*/
+
+#define LEVEL_BINARY_MAGIC     "LVLB"
+#define LEVEL_BINARY_VERSION   2
+#define LEVEL_BINARY_EXTENSION ".lvl"
+
+#define LEVEL_DEFAULT_WIDTH  25
+#define LEVEL_DEFAULT_HEIGHT 25
+
+struct LevelFileHeader {
+    char     magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t tile_offset;      // byte offset of the tile plane
+    uint32_t collision_count;
+    uint32_t collision_offset; // byte offset of the collision table
+    uint32_t layers;           // 0 in version 1 files, which have one layer
+};
+
+// pre-baked collision rectangle of a version 1 file, same meaning as CollisionGeometry
+struct LevelFileRect {
+    int32_t x;
+    int32_t y;
+    int32_t w;
+    int32_t h;
+};
+
+// pre-baked collision box, same meaning as CollisionBox
+struct LevelFileBox {
+    int32_t x;
+    int32_t y;
+    int32_t z;
+    int32_t w;
+    int32_t h;
+    int32_t d;
+};
+
+static_assert(sizeof(LevelFileHeader) == 32, "LevelFileHeader must be packed");
+static_assert(sizeof(LevelFileRect) == 16, "LevelFileRect must be packed");
+static_assert(sizeof(LevelFileBox) == 24, "LevelFileBox must be packed");
+
+bool isBinaryLevelName(const std::string& filename) {
+    const std::string ext = LEVEL_BINARY_EXTENSION;
+    return filename.size() >= ext.size() &&
+        filename.compare(filename.size() - ext.size(), ext.size(), ext) == 0;
+}
+
+// read-only mmap of a whole file
+class MappedFile {
+    int fd;
+    void* base;
+    size_t length;
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+public:
+    MappedFile(void) : fd(-1), base(MAP_FAILED), length(0) {}
+    ~MappedFile(void) { this->close(); }
+
+    // an empty file opens fine and has size() == 0
+    bool open(const std::string& filename) {
+        this->close();
+
+        this->fd = ::open(filename.c_str(), O_RDONLY);
+        if(this->fd < 0)
+            return false;
+
+        struct stat st;
+        if(fstat(this->fd, &st) < 0) {
+            this->close();
+            return false;
+        }
+
+        this->length = st.st_size;
+        if(this->length == 0)
+            return true;
+
+        this->base = mmap(NULL, this->length, PROT_READ, MAP_PRIVATE, this->fd, 0);
+        if(this->base == MAP_FAILED) {
+            this->close();
+            return false;
+        }
+
+        return true;
+    }
+
+    void close(void) {
+        if(this->base != MAP_FAILED)
+            munmap(this->base, this->length);
+        if(this->fd >= 0)
+            ::close(this->fd);
+
+        this->fd = -1;
+        this->base = MAP_FAILED;
+        this->length = 0;
+    }
+
+    bool isOpen(void) const { return this->fd >= 0; }
+
+    const uint8_t* data(void) const {
+        return this->base == MAP_FAILED ? NULL : reinterpret_cast<const uint8_t*>(this->base); }
+
+    size_t size(void) const { return this->length; }
+};
+
+// read-only, zero-copy view of a binary level file
+class MappedLevel {
+    MappedFile file;
+    const LevelFileHeader* header;
+
+    MappedLevel(const MappedLevel&) = delete;
+    MappedLevel& operator=(const MappedLevel&) = delete;
+
+public:
+    MappedLevel(void) : header(NULL) {}
+
+    // returns false if the file is missing, is not a binary level
+    // or is truncated. callers fall back to the text format
+    bool open(const std::string& filename) {
+        this->close();
+
+        if(!this->file.open(filename) || this->file.size() < sizeof(LevelFileHeader)) {
+            this->close();
+            return false;
+        }
+
+        this->header = reinterpret_cast<const LevelFileHeader*>(this->file.data());
+
+        if(memcmp(header->magic, LEVEL_BINARY_MAGIC, 4) != 0 ||
+                header->version < 1 || header->version > LEVEL_BINARY_VERSION ||
+                (header->version > 1 && header->layers == 0)) {
+            this->close();
+            return false;
+        }
+
+        // sizes are ints everywhere past this point
+        if(header->width > INT32_MAX || header->height > INT32_MAX || header->layers > INT32_MAX) {
+            this->close();
+            return false;
+        }
+
+        const uint64_t length = this->file.size();
+        const uint64_t tiles = uint64_t(header->width) * header->height * this->depth();
+        const uint64_t rects = uint64_t(header->collision_count) * this->boxSize();
+
+        if(uint64_t(header->tile_offset) + tiles > length ||
+                uint64_t(header->collision_offset) + rects > length ||
+                header->collision_offset % alignof(LevelFileBox) != 0) {
+            this->close();
+            return false;
+        }
+
+        return true;
+    }
+
+    void close(void) {
+        this->file.close();
+        this->header = NULL;
+    }
+
+    int width(void) const { return this->header->width; }
+    int height(void) const { return this->header->height; }
+    int depth(void) const { return this->header->version == 1 ? 1 : this->header->layers; }
+
+    // every layer, one after the other. points straight into the mapping
+    const uint8_t* tiles(void) const {
+        return this->file.data() + header->tile_offset; }
+
+    // tile type at (y, x) of layer z
+    uint8_t tile(int y, int x, int z = 0) const {
+        return this->tiles()[(size_t(z) * this->height() + y) * this->width() + x]; }
+
+    int boxCount(void) const { return this->header->collision_count; }
+
+    // version 1 rectangles come back as boxes on layer 0
+    LevelFileBox box(int i) const {
+        const uint8_t* p = this->file.data() + header->collision_offset + size_t(i) * this->boxSize();
+
+        if(this->header->version == 1) {
+            const LevelFileRect* r = reinterpret_cast<const LevelFileRect*>(p);
+            return { r->x, r->y, 0, r->w, r->h, 1 };
+        }
+        return *reinterpret_cast<const LevelFileBox*>(p);
+    }
+
+private:
+    size_t boxSize(void) const {
+        return this->header->version == 1 ? sizeof(LevelFileRect) : sizeof(LevelFileBox); }
+};
+
+// scans a text map straight out of the mapped file. nothing is copied or
+// allocated per token, the cursor just walks the bytes. on a bad token
+// the read fails and error() says where it happened:
+//
+//     TextMapReader rd;
+//     int w, h, l, t;
+//     if(!rd.open(filename) || !rd.readHeader(w, h, l)) ...
+//     for each tile: if(!rd.readTile(t)) ... rd.error()
+//     rd.readInt(n) for the collision count and rectangles
+//
+class TextMapReader {
+    MappedFile file;
+
+    const char* begin;
+    const char* cur;
+    const char* end;
+
+    std::string err;
+
+    static bool isSpace(char c) {
+        return c == ' ' || c == '\n' || c == '\t' || c == '\r'; }
+
+    void skipSpace(void) {
+        while(this->cur < this->end && isSpace(*this->cur))
+            this->cur++;
+    }
+
+    // skips spaces and tabs but stops at the end of the line
+    void skipBlank(void) {
+        while(this->cur < this->end && (*this->cur == ' ' || *this->cur == '\t' || *this->cur == '\r'))
+            this->cur++;
+    }
+
+    // the token starting at the cursor, for error messages
+    std::string token(void) const {
+        const char* p = this->cur;
+        while(p < this->end && !isSpace(*p) && p - this->cur < 16)
+            p++;
+        return std::string(this->cur, p);
+    }
+
+    // line/column are only worked out when something goes wrong
+    bool fail(const std::string& msg) {
+        int line = 1;
+        const char* line_start = this->begin;
+        for(const char* p = this->begin; p < this->cur; p++) {
+            if(*p == '\n') {
+                line++;
+                line_start = p + 1;
+            }
+        }
+
+        this->err = "line " + std::to_string(line) +
+            ", column " + std::to_string(this->cur - line_start + 1) + ": " + msg;
+        return false;
+    }
+
+    bool parseInt(long& v) {
+        const char* p = this->cur;
+        bool neg = false;
+        if(p < this->end && (*p == '-' || *p == '+')) {
+            neg = (*p == '-');
+            p++;
+        }
+
+        if(p == this->end || *p < '0' || *p > '9')
+            return false;
+
+        // nothing in a map file goes past 32 bits, a longer run of digits
+        // is an error rather than something to wrap around
+        long n = 0;
+        while(p < this->end && *p >= '0' && *p <= '9') {
+            n = n * 10 + (*p - '0');
+            if(n > INT32_MAX)
+                return false;
+            p++;
+        }
+
+        if(p < this->end && !isSpace(*p))
+            return false;
+
+        v = neg ? -n : n;
+        this->cur = p;
+        return true;
+    }
+
+public:
+    TextMapReader(void) : begin(NULL), cur(NULL), end(NULL) {}
+
+    bool open(const std::string& filename) {
+        if(!this->file.open(filename)) {
+            this->err = "cannot open map file";
+            return false;
+        }
+
+        this->begin = this->cur = reinterpret_cast<const char*>(this->file.data());
+        this->end = this->begin + this->file.size();
+        this->err.clear();
+        return true;
+    }
+
+    const std::string& error(void) const { return this->err; }
+
+    // 'MAPDATA <width> <height> [<layers>]' or a bare 'MAPDATA' (25x25)
+    bool readHeader(int& width, int& height, int& layers) {
+        this->skipSpace();
+
+        static const char tag[] = "MAPDATA";
+        const size_t n = sizeof(tag) - 1;
+
+        if(size_t(this->end - this->cur) < n || memcmp(this->cur, tag, n) != 0 ||
+                (this->cur + n < this->end && !isSpace(this->cur[n])))
+            return this->fail("missing MAPDATA header");
+
+        this->cur += n;
+        this->skipBlank();
+
+        width  = LEVEL_DEFAULT_WIDTH;
+        height = LEVEL_DEFAULT_HEIGHT;
+        layers = 1;
+
+        if(this->cur == this->end || *this->cur == '\n')
+            return true;
+
+        long w, h;
+        if(!this->parseInt(w))
+            return this->fail("expected map width, got '" + this->token() + "'");
+
+        this->skipBlank();
+        if(!this->parseInt(h))
+            return this->fail("expected map height, got '" + this->token() + "'");
+
+        if(w <= 0 || h <= 0 || w > INT32_MAX || h > INT32_MAX)
+            return this->fail("invalid map size");
+
+        width  = w;
+        height = h;
+
+        this->skipBlank();
+        if(this->cur == this->end || *this->cur == '\n')
+            return true;
+
+        long l;
+        if(!this->parseInt(l) || l <= 0 || l > INT32_MAX)
+            return this->fail("expected layer count, got '" + this->token() + "'");
+
+        layers = l;
+        return true;
+    }
+
+    // one tile type, only 0, 1 and 2 are accepted
+    bool readTile(int& t) {
+        this->skipSpace();
+
+        if(this->cur == this->end)
+            return this->fail("map ends early");
+
+        const char c = *this->cur;
+        if(c < '0' || c > '2' || (this->cur + 1 < this->end && !isSpace(this->cur[1])))
+            return this->fail("invalid tile '" + this->token() + "'");
+
+        t = c - '0';
+        this->cur++;
+        return true;
+    }
+
+    bool readInt(long& v) {
+        this->skipSpace();
+
+        if(this->cur == this->end)
+            return this->fail("map ends early");
+
+        if(!this->parseInt(v))
+            return this->fail("expected a number, got '" + this->token() + "'");
+
+        return true;
+    }
+};
+
+// whether a map this big can be written in the binary format. header
+// offsets are 32 bits, so the tile planes have to end below 4GB
+bool binaryLevelFits(int width, int height, int depth, size_t box_count) {
+    const uint64_t collision_offset = (sizeof(LevelFileHeader) + uint64_t(width) * height * depth + 3) & ~3ull;
+    return collision_offset <= UINT32_MAX && box_count <= UINT32_MAX;
+}
+
+// row(z, y, uint8_t* dst) fills in one row of width tile types at a time
+// so the caller never has to build a dense copy of the whole map. false
+// without writing anything if the map doesn't binaryLevelFits()
+template<typename RowFn>
+bool saveBinaryLevel(
+        const std::string& filename, int width, int height, int depth,
+        RowFn row, const std::vector<LevelFileBox>& boxes) {
+
+    if(!binaryLevelFits(width, height, depth, boxes.size()))
+        return false;
+
+    LevelFileHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, LEVEL_BINARY_MAGIC, 4);
+
+    const uint64_t tile_bytes = uint64_t(width) * height * depth;
+
+    hdr.version          = LEVEL_BINARY_VERSION;
+    hdr.width            = width;
+    hdr.height           = height;
+    hdr.tile_offset      = sizeof(LevelFileHeader);
+    hdr.collision_count  = boxes.size();
+    hdr.collision_offset = (hdr.tile_offset + tile_bytes + 3) & ~3ull;
+    hdr.layers           = depth;
+
+    FILE* fp = fopen(filename.c_str(), "wb");
+    if(fp == NULL)
+        return false;
+
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1;
+
+    std::vector<uint8_t> buf(width);
+    for(int z = 0; ok && z < depth; z++) {
+        for(int y = 0; ok && y < height; y++) {
+            row(z, y, buf.data());
+            ok = fwrite(buf.data(), 1, width, fp) == size_t(width);
+        }
+    }
+
+    const char pad[4] = { 0, 0, 0, 0 };
+    const size_t padding = hdr.collision_offset - hdr.tile_offset - tile_bytes;
+
+    ok = ok &&
+        fwrite(pad, 1, padding, fp) == padding &&
+        fwrite(boxes.data(), sizeof(LevelFileBox), boxes.size(), fp) == boxes.size();
+
+    return (fclose(fp) == 0) && ok;
+}
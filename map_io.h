@@ -0,0 +1,224 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <algorithm>
+
+#include "map_format.h"
+#include "tile_map.h"
+#include "collision.h"
+
+// loading/saving a whole map, text or binary. errors are handed back
+// to the caller instead of ending the process so headless tools can keep
+// going when one map out of many is bad
+
+// lm is reset to the dimensions in the file. on failure error says why
+bool loadMap(const std::string& filename, LayeredTileMap& lm, std::string& error);
+
+// binary if filename ends in LEVEL_BINARY_EXTENSION, text otherwise
+bool saveMap(
+        const std::string& filename, const LayeredTileMap& lm,
+        const std::vector<CollisionBox>& boxes, std::string& error);
+
+// same as saveMap but the format is given instead of going by filename
+bool saveMapAs(
+        const std::string& filename, bool binary, const LayeredTileMap& lm,
+        const std::vector<CollisionBox>& boxes, std::string& error);
+
+// same as saveMap but never leaves a half-written file behind: writes a
+// temporary next to filename, fsyncs it and renames it over the original.
+// the format goes by filename, not by the temporary's name
+bool saveMapDurable(
+        const std::string& filename, const LayeredTileMap& lm,
+        const std::vector<CollisionBox>& boxes, std::string& error);
+
+// ==================================================================
+// implementation
+// ==================================================================
+
+bool loadMap(const std::string& filename, LayeredTileMap& lm, std::string& error) {
+
+    MappedLevel ml;
+    if(ml.open(filename)) {
+        lm.reset(ml.width(), ml.height(), ml.depth());
+
+        for(int z = 0; z < ml.depth(); z++) {
+            TileMap& ta = lm.layer(z);
+
+            for(int y = 0; y < ml.height(); y++) {
+                for(int x = 0; x < ml.width(); x++) {
+                    int t = ml.tile(y, x, z);
+                    if(t != Tile_t::DEFAULT && t != Tile_t::BARRIER && t != Tile_t::SPAWN_POINT) {
+                        error = "layer " + std::to_string(z) +
+                            ", row " + std::to_string(y + 1) + ", column " + std::to_string(x + 1) +
+                            ": invalid tile " + std::to_string(t);
+                        return false;
+                    }
+                    if(t != Tile_t::DEFAULT)
+                        ta.set(y, x, t);
+                }
+            }
+        }
+        return true;
+    }
+
+    TextMapReader rd;
+
+    int width, height, depth;
+    if(!rd.open(filename) || !rd.readHeader(width, height, depth)) {
+        error = rd.error();
+        return false;
+    }
+
+    lm.reset(width, height, depth);
+
+    for(int z = 0; z < depth; z++) {
+        TileMap& ta = lm.layer(z);
+
+        for(int y = 0; y < height; y++) {
+            for(int x = 0; x < width; x++) {
+                int t;
+                if(!rd.readTile(t)) {
+                    error = rd.error();
+                    return false;
+                }
+
+                // DEFAULT is what the map starts out as, skip the chunk lookup
+                if(t != Tile_t::DEFAULT)
+                    ta.set(y, x, t);
+            }
+        }
+    }
+
+    return true;
+}
+
+bool saveMap(
+        const std::string& filename, const LayeredTileMap& lm,
+        const std::vector<CollisionBox>& boxes, std::string& error) {
+    return saveMapAs(filename, isBinaryLevelName(filename), lm, boxes, error);
+}
+
+bool saveMapAs(
+        const std::string& filename, bool binary, const LayeredTileMap& lm,
+        const std::vector<CollisionBox>& boxes, std::string& error) {
+
+    const int width = lm.getWidth();
+    const int height = lm.getHeight();
+    const int depth = lm.getDepth();
+
+    if(binary) {
+        std::vector<LevelFileBox> fboxes;
+        fboxes.reserve(boxes.size());
+        for(auto& b : boxes)
+            fboxes.push_back({ b.x, b.y, b.z, b.w, b.h, b.d });
+
+        auto row = [&lm, width](int z, int y, uint8_t* dst) {
+            for(int x = 0; x < width; x++)
+                dst[x] = lm.layer(z).get(y, x);
+        };
+
+        if(!binaryLevelFits(width, height, depth, fboxes.size())) {
+            error = "map is too big for the binary format, save it as text";
+            return false;
+        }
+
+        if(!saveBinaryLevel(filename, width, height, depth, row, fboxes)) {
+            error = "error writing binary map file";
+            return false;
+        }
+        return true;
+    }
+
+    FILE* fp = fopen(filename.c_str(), "wb");
+    if(fp == NULL) {
+        error = "cannot open map file for writing";
+        return false;
+    }
+
+    // older readers only know the bare header of the original fixed 25x25
+    // layout, so that size keeps it. anything else needs the size (and
+    // layer count) in the header, which only newer readers understand
+    std::string out = "MAPDATA";
+    if(width != LEVEL_DEFAULT_WIDTH || height != LEVEL_DEFAULT_HEIGHT || depth > 1) {
+        out += ' ' + std::to_string(width) + ' ' + std::to_string(height);
+        if(depth > 1)
+            out += ' ' + std::to_string(depth);
+    }
+    out += '\n';
+
+    // one row at a time, each chunk word is looked up once per 64 tiles
+    std::string line(size_t(width) * 2 + 1, ' ');
+    line.back() = '\n';
+
+    bool ok = fwrite(out.data(), 1, out.size(), fp) == out.size();
+
+    for(int z = 0; ok && z < depth; z++) {
+        const TileMap& ta = lm.layer(z);
+
+        for(int y = 0; ok && y < height; y++) {
+            for(int wx = 0; (wx << TILE_CHUNK_SHIFT) < width; wx++) {
+                const TileWord_t b = ta.barrierWord(y, wx);
+                const TileWord_t sp = ta.spawnWord(y, wx);
+
+                const int x0 = wx << TILE_CHUNK_SHIFT;
+                const int n = std::min(TILE_CHUNK_SIZE, width - x0);
+
+                for(int i = 0; i < n; i++) {
+                    const TileWord_t m = TileWord_t(1) << i;
+                    line[size_t(x0 + i) * 2] = (b & m) ? '1' : (sp & m) ? '2' : '0';
+                }
+            }
+
+            ok = fwrite(line.data(), 1, line.size(), fp) == line.size();
+        }
+    }
+
+    out = std::to_string(boxes.size()) + '\n';
+    for(auto& b : boxes) {
+        out += std::to_string(b.x) + ' ' + std::to_string(b.y) + ' ' +
+            std::to_string(b.h) + ' ' + std::to_string(b.w);
+        if(depth > 1)
+            out += ' ' + std::to_string(b.z) + ' ' + std::to_string(b.d);
+        out += '\n';
+    }
+
+    ok = ok && fwrite(out.data(), 1, out.size(), fp) == out.size();
+
+    if(fclose(fp) != 0 || !ok) {
+        error = "error writing text map file";
+        return false;
+    }
+    return true;
+}
+
+bool saveMapDurable(
+        const std::string& filename, const LayeredTileMap& lm,
+        const std::vector<CollisionBox>& boxes, std::string& error) {
+
+    const std::string tmp = filename + ".tmp";
+
+    if(!saveMapAs(tmp, isBinaryLevelName(filename), lm, boxes, error)) {
+        unlink(tmp.c_str());
+        return false;
+    }
+
+    int fd = open(tmp.c_str(), O_RDONLY);
+    if(fd < 0 || fsync(fd) != 0) {
+        if(fd >= 0)
+            close(fd);
+        unlink(tmp.c_str());
+        error = "error syncing map file to disk";
+        return false;
+    }
+    close(fd);
+
+    if(rename(tmp.c_str(), filename.c_str()) != 0) {
+        unlink(tmp.c_str());
+        error = "error replacing map file";
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+
+#include "nav_graph.h"
+
+// connected regions of a NavGrid, kept in a union-find over the cells.
+// two cells in different components can never reach each other, so
+// reachable() turns a search that would flood a whole region before
+// giving up into a couple of array lookups.
+//
+// opening a cell is patched in place (it joins its neighbors'
+// components). closing one might split a component, which union-find
+// can't undo, so that just marks the labels stale and the next query
+// relabels the whole grid
+class NavComponents {
+    std::vector<int> parent; // -1 for walls
+    std::vector<int> count;  // cells in the component, only valid at roots
+    int components;
+    bool stale;
+
+    int root(int i) {
+        while(this->parent[i] != i) {
+            // path halving, every other step now points at its grandparent
+            this->parent[i] = this->parent[this->parent[i]];
+            i = this->parent[i];
+        }
+        return i;
+    }
+
+    void join(int a, int b) {
+        a = this->root(a);
+        b = this->root(b);
+        if(a == b)
+            return;
+
+        // smaller tree goes under the bigger one
+        if(this->count[a] < this->count[b])
+            std::swap(a, b);
+        this->parent[b] = a;
+        this->count[a] += this->count[b];
+        this->components--;
+    }
+
+    void refresh(const NavGrid& g) {
+        if(this->stale)
+            this->build(g);
+    }
+
+public:
+    NavComponents(void) : components(0), stale(false) {}
+
+    void build(const NavGrid& g) {
+        const int n = g.cellCount();
+        this->parent.assign(n, -1);
+        this->count.assign(n, 0);
+        this->components = 0;
+        this->stale = false;
+
+        for(int i = 0; i < n; i++) {
+            if(!g.walkable(i))
+                continue;
+
+            this->parent[i] = i;
+            this->count[i] = 1;
+            this->components++;
+
+            // row-major, so only the neighbors already seen need joining
+            const uint8_t l = g.links(i);
+            if(l & NavDir::NORTH) this->join(i, i - g.getWidth());
+            if(l & NavDir::WEST)  this->join(i, i - 1);
+        }
+    }
+
+    // call after (y, x) was made walkable or not in g
+    void tileChanged(const NavGrid& g, int y, int x) {
+        if(this->stale || !g.inBounds(y, x))
+            return;
+
+        const int i = g.index(y, x);
+
+        if(!g.walkable(i)) {
+            if(this->parent[i] >= 0)
+                this->stale = true;
+            return;
+        }
+
+        if(this->parent[i] >= 0)
+            return;
+
+        this->parent[i] = i;
+        this->count[i] = 1;
+        this->components++;
+        g.forEachNeighbor(i, [this, i](int j) { this->join(i, j); });
+    }
+
+    // label shared by every cell of a component, -1 for walls
+    int componentOf(const NavGrid& g, int i) {
+        this->refresh(g);
+        return this->parent[i] < 0 ? -1 : this->root(i);
+    }
+
+    // true if there is any path from a to b
+    bool reachable(const NavGrid& g, int a, int b) {
+        const int ca = this->componentOf(g, a);
+        return ca >= 0 && ca == this->componentOf(g, b);
+    }
+
+    int componentCount(const NavGrid& g) {
+        this->refresh(g);
+        return this->components;
+    }
+};
+
+// spawn points of ta that can't walk to the first one (in forEachTile
+// order), (y, x) into out. returns that first spawn point's cell, -1 if
+// there are none. g and cc have to be up to date with ta
+int find_unreachable_spawns(
+        const TileMap& ta, const NavGrid& g, NavComponents& cc,
+        std::vector<std::pair<int,int>>& out) {
+
+    out.clear();
+    int first = -1;
+
+    ta.forEachTile([&](int y, int x, int type) {
+        if(type != Tile_t::SPAWN_POINT)
+            return;
+
+        const int i = g.index(y, x);
+        if(first < 0)
+            first = i;
+        else if(!cc.reachable(g, i, first))
+            out.push_back({ y, x });
+    });
+
+    return first;
+}
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "tile_map.h"
+
+// navigation graph over a tile grid. cells are indexed y*width+x and each
+// one is a single byte: whether it can be walked on plus one bit per
+// neighbor it is linked to. no pointers, no per-node allocation, a whole
+// search touches nothing but a couple of flat arrays
+
+struct NavDir {
+    static const uint8_t NORTH = 0x01;
+    static const uint8_t SOUTH = 0x02;
+    static const uint8_t EAST  = 0x04;
+    static const uint8_t WEST  = 0x08;
+    static const uint8_t ALL   = 0x0F;
+};
+
+class NavGrid {
+    int width;
+    int height;
+
+    std::vector<uint8_t> cells; // NavDir bits | WALKABLE
+    size_t nodes;
+
+public:
+    static const uint8_t WALKABLE = 0x10;
+
+    // cell indices are ints, and PathCache packs two of them into one key
+    enum { MAX_CELLS = 1 << 30 };
+
+    static bool fits(int width, int height) {
+        return width >= 0 && height >= 0 && int64_t(width) * height <= MAX_CELLS; }
+
+    // a size that doesn't fit() gets an empty 0x0 grid, nothing is walkable
+    NavGrid(int width = 0, int height = 0) : width(0), height(0), nodes(0) {
+        this->reset(width, height); }
+
+    // every cell becomes a wall again
+    void reset(int width, int height) {
+        if(!fits(width, height))
+            width = height = 0;
+
+        this->width = width;
+        this->height = height;
+        this->cells.assign(size_t(width) * height, 0);
+        this->nodes = 0;
+    }
+
+    // one node for every non-barrier tile
+    void build(const TileMap& ta) {
+        this->reset(ta.getWidth(), ta.getHeight());
+
+        for(int y = 0; y < this->height; y++)
+            for(int x = 0; x < this->width; x++)
+                if(ta.get(y, x) != Tile_t::BARRIER)
+                    this->insertNode(y, x);
+    }
+
+    int getWidth(void) const { return this->width; }
+    int getHeight(void) const { return this->height; }
+    int cellCount(void) const { return this->cells.size(); }
+    size_t nodeCount(void) const { return this->nodes; }
+
+    size_t memoryUsage(void) const { return this->cells.capacity(); }
+
+    bool inBounds(int y, int x) const {
+        return y >= 0 && x >= 0 && y < this->height && x < this->width; }
+
+    int index(int y, int x) const { return y * this->width + x; }
+    int cellY(int i) const { return i / this->width; }
+    int cellX(int i) const { return i % this->width; }
+
+    bool walkable(int i) const { return this->cells[i] & WALKABLE; }
+    bool walkable(int y, int x) const {
+        return this->inBounds(y, x) && this->walkable(this->index(y, x)); }
+
+    // NavDir bits of the neighbors cell i is linked to
+    uint8_t links(int i) const { return this->cells[i] & NavDir::ALL; }
+
+    // cell index one step from i in direction dir (a single NavDir bit)
+    int step(int i, uint8_t dir) const {
+        switch(dir) {
+            case NavDir::NORTH: return i - this->width;
+            case NavDir::SOUTH: return i + this->width;
+            case NavDir::EAST:  return i + 1;
+            default:            return i - 1;
+        }
+    }
+
+    // makes (y, x) walkable and links it to its walkable neighbors
+    void insertNode(int y, int x) {
+        if(!this->inBounds(y, x))
+            return;
+
+        const int i = this->index(y, x);
+        if(this->walkable(i))
+            return;
+
+        this->cells[i] |= WALKABLE;
+        this->nodes++;
+
+        if(y > 0 && this->walkable(i - this->width)) {
+            this->cells[i] |= NavDir::NORTH;
+            this->cells[i - this->width] |= NavDir::SOUTH;
+        }
+        if(y + 1 < this->height && this->walkable(i + this->width)) {
+            this->cells[i] |= NavDir::SOUTH;
+            this->cells[i + this->width] |= NavDir::NORTH;
+        }
+        if(x + 1 < this->width && this->walkable(i + 1)) {
+            this->cells[i] |= NavDir::EAST;
+            this->cells[i + 1] |= NavDir::WEST;
+        }
+        if(x > 0 && this->walkable(i - 1)) {
+            this->cells[i] |= NavDir::WEST;
+            this->cells[i - 1] |= NavDir::EAST;
+        }
+    }
+
+    // makes (y, x) a wall again and unlinks it from its neighbors
+    void removeNode(int y, int x) {
+        if(!this->inBounds(y, x))
+            return;
+
+        const int i = this->index(y, x);
+        if(!this->walkable(i))
+            return;
+
+        const uint8_t l = this->cells[i];
+        if(l & NavDir::NORTH) this->cells[i - this->width] &= ~NavDir::SOUTH;
+        if(l & NavDir::SOUTH) this->cells[i + this->width] &= ~NavDir::NORTH;
+        if(l & NavDir::EAST)  this->cells[i + 1] &= ~NavDir::WEST;
+        if(l & NavDir::WEST)  this->cells[i - 1] &= ~NavDir::EAST;
+
+        this->cells[i] = 0;
+        this->nodes--;
+    }
+
+    // walkable or not depending on the tile type, only (y, x) and its
+    // four neighbors are touched
+    void updateTile(int y, int x, int type) {
+        if(type == Tile_t::BARRIER)
+            this->removeNode(y, x);
+        else
+            this->insertNode(y, x);
+    }
+
+    // f(neighbor index) for every neighbor i is linked to
+    template<typename F>
+    void forEachNeighbor(int i, F f) const {
+        const uint8_t l = this->cells[i];
+        if(l & NavDir::NORTH) f(i - this->width);
+        if(l & NavDir::SOUTH) f(i + this->width);
+        if(l & NavDir::EAST)  f(i + 1);
+        if(l & NavDir::WEST)  f(i - 1);
+    }
+};
+
+// compressed sparse row adjacency for graphs that aren't a plain grid
+// (portals, one-way links, abstract graphs built on top of a grid). the
+// neighbors of node i are targets[offsets[i] .. offsets[i+1])
+struct NavCSR {
+    std::vector<int> offsets;
+    std::vector<int> targets;
+
+    int nodeCount(void) const { return this->offsets.empty() ? 0 : this->offsets.size() - 1; }
+
+    // same nodes and links as the grid, node i is cell i
+    void fromGrid(const NavGrid& g) {
+        this->offsets.assign(g.cellCount() + 1, 0);
+        this->targets.clear();
+
+        for(int i = 0; i < g.cellCount(); i++) {
+            g.forEachNeighbor(i, [this](int j) { this->targets.push_back(j); });
+            this->offsets[i + 1] = this->targets.size();
+        }
+    }
+
+    // edges is a list of (from, to) pairs, nodes are [0, nodes)
+    void fromEdges(int nodes, const std::vector<std::pair<int,int>>& edges) {
+        this->offsets.assign(nodes + 1, 0);
+        for(auto& e : edges)
+            this->offsets[e.first + 1]++;
+        for(int i = 0; i < nodes; i++)
+            this->offsets[i + 1] += this->offsets[i];
+
+        this->targets.resize(edges.size());
+        std::vector<int> fill(this->offsets.begin(), this->offsets.end() - 1);
+        for(auto& e : edges)
+            this->targets[fill[e.first]++] = e.second;
+    }
+
+    template<typename F>
+    void forEachNeighbor(int i, F f) const {
+        for(int k = this->offsets[i]; k < this->offsets[i + 1]; k++)
+            f(this->targets[k]);
+    }
+};
@@ -0,0 +1,489 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+
+#include "nav_graph.h"
+#include "visit_stamps.h"
+
+// hierarchical pathfinding (HPA*) over a NavGrid. the map is cut into
+// square clusters. wherever a run of walkable cells lines up on both sides
+// of a cluster edge, one or two entrance cells are picked on each side and
+// the steps between every pair of entrances inside a cluster are worked
+// out ahead of time. a query searches that small abstract graph of
+// entrances first and then only walks cells inside the clusters the
+// route passes through, so its cost grows with the number of clusters
+// crossed rather than the size of the map.
+//
+// paths are close to shortest but not always shortest. editing a tile
+// only throws away the cluster it is in (and the neighbor across the
+// edge if it sits on one), those get redone on the next query
+class NavHierarchy {
+    struct Cluster {
+        std::vector<int> entrances; // cells, sorted
+        std::vector<int> dist;      // entrances x entrances steps inside the cluster, -1 if not connected
+        int first;                  // abstract node id of entrances[0]
+        bool dirty;
+    };
+
+    struct OpenNode {
+        int f;
+        int g;
+        int node;
+    };
+
+    struct OpenCompare {
+        bool operator()(const OpenNode& a, const OpenNode& b) const {
+            return a.f != b.f ? a.f > b.f : a.g < b.g; }
+    };
+
+    // runs of open edge shorter than this get one entrance in the middle,
+    // longer ones one at each end
+    static const int WIDE_ENTRANCE = 6;
+
+    int width;
+    int height;
+    int size;   // cluster edge length in tiles
+    int cols;   // clusters across
+    int rows;   // clusters down
+    bool dirty; // some cluster needs redoing
+
+    std::vector<Cluster> clusters;
+
+    // abstract node id -> cell
+    std::vector<int> node_cell;
+
+    // search inside one cluster, indexed by position in the cluster.
+    // local_links is a copy of the cluster's links with the ones that
+    // leave it masked off, for cluster local_cluster
+    std::vector<uint8_t> local_links;
+    int local_cluster;
+    std::vector<int> local_dist;
+    std::vector<int> local_from;
+    std::vector<int> local_queue;
+
+    // search over the abstract graph. start and goal get the two ids
+    // past the last entrance
+    VisitStamps abs_marks;
+    std::vector<int> abs_g;
+    std::vector<int> abs_from;
+    std::vector<OpenNode> open;
+    std::vector<int> start_dist; // start -> each entrance of its cluster
+    std::vector<int> goal_dist;  // same for the goal
+    std::vector<int> route;
+
+    size_t expanded;
+
+    int clusterOf(const NavGrid& g, int cell) const {
+        return (g.cellY(cell) / this->size) * this->cols + g.cellX(cell) / this->size; }
+
+    int localOf(const NavGrid& g, int c, int cell) const {
+        return (g.cellY(cell) - (c / this->cols) * this->size) * this->size +
+               (g.cellX(cell) - (c % this->cols) * this->size);
+    }
+
+    static int manhattan(const NavGrid& g, int a, int b) {
+        return std::abs(g.cellY(a) - g.cellY(b)) + std::abs(g.cellX(a) - g.cellX(b)); }
+
+    void markDirty(int cy, int cx) {
+        if(cy < 0 || cx < 0 || cy >= this->rows || cx >= this->cols)
+            return;
+        this->clusters[cy * this->cols + cx].dirty = true;
+        this->dirty = true;
+    }
+
+    // entrances cluster c gets from the edge it shares with its neighbor
+    // in direction (dy, dx). both clusters walk the edge in the same order
+    // so they always agree on where the entrances are
+    void addEdgeEntrances(const NavGrid& g, int c, int dy, int dx, std::vector<int>& out) const {
+        const int cy = c / this->cols;
+        const int cx = c % this->cols;
+        if(cy + dy < 0 || cx + dx < 0 || cy + dy >= this->rows || cx + dx >= this->cols)
+            return;
+
+        const int y0 = cy * this->size;
+        const int x0 = cx * this->size;
+        const int y1 = std::min(y0 + this->size, this->height);
+        const int x1 = std::min(x0 + this->size, this->width);
+
+        // the cells along the edge on our side
+        const int ey = (dy < 0) ? y0 : (dy > 0) ? y1 - 1 : y0;
+        const int ex = (dx < 0) ? x0 : (dx > 0) ? x1 - 1 : x0;
+        const int n  = (dy != 0) ? x1 - x0 : y1 - y0;
+
+        auto ours = [&](int k) { return (dy != 0) ? g.index(ey, ex + k) : g.index(ey + k, ex); };
+        auto crossable = [&](int k) {
+            return (dy != 0) ?
+                g.walkable(ey, ex + k) && g.walkable(ey + dy, ex + k) :
+                g.walkable(ey + k, ex) && g.walkable(ey + k, ex + dx);
+        };
+
+        for(int k = 0; k < n; ) {
+            if(!crossable(k)) {
+                k++;
+                continue;
+            }
+
+            const int s = k;
+            while(k < n && crossable(k))
+                k++;
+
+            if(k - s < WIDE_ENTRANCE)
+                out.push_back(ours((s + k - 1) / 2));
+            else {
+                out.push_back(ours(s));
+                out.push_back(ours(k - 1));
+            }
+        }
+    }
+
+    void loadCluster(const NavGrid& g, int c) {
+        if(c == this->local_cluster)
+            return;
+
+        const int y0 = (c / this->cols) * this->size;
+        const int x0 = (c % this->cols) * this->size;
+        const int lh = std::min(this->size, this->height - y0);
+        const int lw = std::min(this->size, this->width - x0);
+
+        std::fill(this->local_links.begin(), this->local_links.end(), 0);
+        for(int ly = 0; ly < lh; ly++) {
+            for(int lx = 0; lx < lw; lx++) {
+                uint8_t l = g.links(g.index(y0 + ly, x0 + lx));
+                if(ly == 0)      l &= ~NavDir::NORTH;
+                if(ly + 1 == lh) l &= ~NavDir::SOUTH;
+                if(lx + 1 == lw) l &= ~NavDir::EAST;
+                if(lx == 0)      l &= ~NavDir::WEST;
+                this->local_links[ly * this->size + lx] = l;
+            }
+        }
+
+        this->local_cluster = c;
+    }
+
+    // breadth first search from cell src that never leaves cluster c.
+    // stops early once stop is reached (pass -1 to search everything)
+    void localSearch(const NavGrid& g, int c, int src, int stop) {
+        this->loadCluster(g, c);
+
+        const int stride = this->size;
+
+        std::fill(this->local_dist.begin(), this->local_dist.end(), -1);
+        this->local_queue.clear();
+
+        const int ls = this->localOf(g, c, src);
+        const int lstop = (stop < 0) ? -1 : this->localOf(g, c, stop);
+
+        this->local_dist[ls] = 0;
+        this->local_from[ls] = ls;
+        this->local_queue.push_back(ls);
+
+        auto visit = [this](int from, int to) {
+            if(this->local_dist[to] >= 0)
+                return;
+            this->local_dist[to] = this->local_dist[from] + 1;
+            this->local_from[to] = from;
+            this->local_queue.push_back(to);
+        };
+
+        for(size_t head = 0; head < this->local_queue.size(); head++) {
+            const int li = this->local_queue[head];
+            if(li == lstop)
+                return;
+
+            const uint8_t l = this->local_links[li];
+            if(l & NavDir::NORTH) visit(li, li - stride);
+            if(l & NavDir::SOUTH) visit(li, li + stride);
+            if(l & NavDir::EAST)  visit(li, li + 1);
+            if(l & NavDir::WEST)  visit(li, li - 1);
+        }
+    }
+
+    int localDistance(const NavGrid& g, int c, int cell) const {
+        return this->local_dist[this->localOf(g, c, cell)]; }
+
+    // cells after from up to and including to, inside cluster c. the last
+    // localSearch must have started at from
+    void appendLocalPath(const NavGrid& g, int c, int from, int to, std::vector<int>& path) {
+        const int y0 = (c / this->cols) * this->size;
+        const int x0 = (c % this->cols) * this->size;
+        const int lfrom = this->localOf(g, c, from);
+
+        const size_t mark = path.size();
+        for(int li = this->localOf(g, c, to); li != lfrom; li = this->local_from[li])
+            path.push_back(g.index(y0 + li / this->size, x0 + li % this->size));
+        std::reverse(path.begin() + mark, path.end());
+    }
+
+    void rebuildCluster(const NavGrid& g, int c) {
+        Cluster& cl = this->clusters[c];
+
+        cl.entrances.clear();
+        this->addEdgeEntrances(g, c, -1,  0, cl.entrances);
+        this->addEdgeEntrances(g, c,  1,  0, cl.entrances);
+        this->addEdgeEntrances(g, c,  0, -1, cl.entrances);
+        this->addEdgeEntrances(g, c,  0,  1, cl.entrances);
+
+        std::sort(cl.entrances.begin(), cl.entrances.end());
+        cl.entrances.erase(std::unique(cl.entrances.begin(), cl.entrances.end()), cl.entrances.end());
+
+        const int k = cl.entrances.size();
+        cl.dist.assign(size_t(k) * k, -1);
+
+        for(int a = 0; a < k; a++) {
+            this->localSearch(g, c, cl.entrances[a], -1);
+            for(int b = 0; b < k; b++)
+                cl.dist[a * k + b] = this->localDistance(g, c, cl.entrances[b]);
+        }
+
+        cl.dirty = false;
+    }
+
+    // redoes every dirty cluster and renumbers the abstract nodes
+    void refresh(const NavGrid& g) {
+        if(!this->dirty)
+            return;
+
+        this->local_cluster = -1;
+
+        for(size_t c = 0; c < this->clusters.size(); c++)
+            if(this->clusters[c].dirty)
+                this->rebuildCluster(g, c);
+
+        this->node_cell.clear();
+        for(auto& cl : this->clusters) {
+            cl.first = this->node_cell.size();
+            this->node_cell.insert(this->node_cell.end(), cl.entrances.begin(), cl.entrances.end());
+        }
+
+        this->dirty = false;
+    }
+
+    // abstract node id of an entrance cell, -1 if the cell isn't one
+    int entranceNode(int c, int cell) const {
+        const Cluster& cl = this->clusters[c];
+        auto iter = std::lower_bound(cl.entrances.begin(), cl.entrances.end(), cell);
+        if(iter == cl.entrances.end() || *iter != cell)
+            return -1;
+        return cl.first + int(iter - cl.entrances.begin());
+    }
+
+    // A* over the entrances. route gets the node ids from start to goal
+    bool abstractSearch(const NavGrid& g, int start, int goal, int start_c, int goal_c) {
+        const int n = this->node_cell.size();
+        const int S = n;
+        const int G = n + 1;
+
+        auto cellOf = [&](int node) { return node == S ? start : node == G ? goal : this->node_cell[node]; };
+
+        this->abs_marks.next(n + 2);
+        this->abs_g.resize(n + 2);
+        this->abs_from.resize(n + 2);
+        this->open.clear();
+
+        OpenCompare cmp;
+
+        auto relax = [&](int from, int to, int ng) {
+            if(this->abs_marks.isClosed(to))
+                return;
+            if(this->abs_marks.isOpen(to) && this->abs_g[to] <= ng)
+                return;
+
+            this->abs_marks.markOpen(to);
+            this->abs_g[to] = ng;
+            this->abs_from[to] = from;
+            this->open.push_back({ ng + manhattan(g, cellOf(to), goal), ng, to });
+            std::push_heap(this->open.begin(), this->open.end(), cmp);
+        };
+
+        this->abs_g[S] = 0;
+        this->abs_from[S] = S;
+        this->abs_marks.markOpen(S);
+        this->open.push_back({ manhattan(g, start, goal), 0, S });
+
+        while(!this->open.empty()) {
+            std::pop_heap(this->open.begin(), this->open.end(), cmp);
+            const OpenNode cur = this->open.back();
+            this->open.pop_back();
+
+            if(this->abs_marks.isClosed(cur.node))
+                continue;
+
+            this->abs_marks.markClosed(cur.node);
+            this->expanded++;
+
+            if(cur.node == G) {
+                this->route.clear();
+                for(int i = G; i != S; i = this->abs_from[i])
+                    this->route.push_back(i);
+                this->route.push_back(S);
+                std::reverse(this->route.begin(), this->route.end());
+                return true;
+            }
+
+            if(cur.node == S) {
+                const Cluster& cl = this->clusters[start_c];
+                for(size_t b = 0; b < cl.entrances.size(); b++)
+                    if(this->start_dist[b] >= 0)
+                        relax(S, cl.first + b, this->start_dist[b]);
+                continue;
+            }
+
+            const int cell = this->node_cell[cur.node];
+            const int c = this->clusterOf(g, cell);
+            const Cluster& cl = this->clusters[c];
+            const int k = cl.entrances.size();
+            const int a = cur.node - cl.first;
+
+            // across the cluster
+            for(int b = 0; b < k; b++)
+                if(b != a && cl.dist[a * k + b] >= 0)
+                    relax(cur.node, cl.first + b, cur.g + cl.dist[a * k + b]);
+
+            // over the edge into the neighbor
+            g.forEachNeighbor(cell, [&](int j) {
+                const int cj = this->clusterOf(g, j);
+                if(cj == c)
+                    return;
+
+                const int node = this->entranceNode(cj, j);
+                if(node >= 0)
+                    relax(cur.node, node, cur.g + 1);
+            });
+
+            if(c == goal_c && this->goal_dist[a] >= 0)
+                relax(cur.node, G, cur.g + this->goal_dist[a]);
+        }
+
+        return false;
+    }
+
+public:
+    NavHierarchy(void) :
+        width(0), height(0), size(1), cols(0), rows(0), dirty(false), local_cluster(-1), expanded(0) {}
+
+    // cuts g into size x size clusters and works out every entrance
+    void build(const NavGrid& g, int size = 16) {
+        this->width = g.getWidth();
+        this->height = g.getHeight();
+        this->size = size;
+        this->cols = (this->width + size - 1) / size;
+        this->rows = (this->height + size - 1) / size;
+
+        this->clusters.assign(size_t(this->cols) * this->rows, Cluster());
+        for(auto& cl : this->clusters)
+            cl.dirty = true;
+        this->dirty = true;
+
+        this->local_links.assign(size_t(size) * size, 0);
+        this->local_cluster = -1;
+        this->local_dist.assign(size_t(size) * size, -1);
+        this->local_from.assign(size_t(size) * size, 0);
+
+        this->refresh(g);
+    }
+
+    // call after (y, x) was made walkable or not in the grid. the
+    // affected clusters are redone lazily by the next findPath
+    void tileChanged(int y, int x) {
+        if(y < 0 || x < 0 || y >= this->height || x >= this->width)
+            return;
+
+        const int cy = y / this->size;
+        const int cx = x / this->size;
+        this->markDirty(cy, cx);
+        this->local_cluster = -1;
+
+        // entrances on a shared edge belong to both clusters
+        if(y % this->size == 0)              this->markDirty(cy - 1, cx);
+        if(y % this->size == this->size - 1) this->markDirty(cy + 1, cx);
+        if(x % this->size == 0)              this->markDirty(cy, cx - 1);
+        if(x % this->size == this->size - 1) this->markDirty(cy, cx + 1);
+    }
+
+    int clusterSize(void) const { return this->size; }
+    int clusterCount(void) const { return this->clusters.size(); }
+    int entranceCount(void) const { return this->node_cell.size(); }
+
+    // path from start to goal (cells, both included) on the same grid the
+    // hierarchy was built from. false and an empty path if there is none
+    bool findPath(const NavGrid& g, int start, int goal, std::vector<int>& path) {
+        path.clear();
+        this->expanded = 0;
+
+        if(!g.walkable(start) || !g.walkable(goal))
+            return false;
+
+        this->refresh(g);
+
+        const int start_c = this->clusterOf(g, start);
+        const int goal_c = this->clusterOf(g, goal);
+
+        // close enough to stay inside one cluster
+        this->localSearch(g, start_c, start, -1);
+        if(start_c == goal_c && this->localDistance(g, start_c, goal) >= 0) {
+            path.push_back(start);
+            this->appendLocalPath(g, start_c, start, goal, path);
+            return true;
+        }
+
+        const Cluster& sc = this->clusters[start_c];
+        this->start_dist.resize(sc.entrances.size());
+        for(size_t b = 0; b < sc.entrances.size(); b++)
+            this->start_dist[b] = this->localDistance(g, start_c, sc.entrances[b]);
+
+        const Cluster& gc = this->clusters[goal_c];
+        this->localSearch(g, goal_c, goal, -1);
+        this->goal_dist.resize(gc.entrances.size());
+        for(size_t b = 0; b < gc.entrances.size(); b++)
+            this->goal_dist[b] = this->localDistance(g, goal_c, gc.entrances[b]);
+
+        if(!this->abstractSearch(g, start, goal, start_c, goal_c))
+            return false;
+
+        // walk the route cell by cell. hops between clusters are single
+        // steps, everything else is a short search inside one cluster
+        const int n = this->node_cell.size();
+        auto cellOf = [&](int node) { return node == n ? start : node == n + 1 ? goal : this->node_cell[node]; };
+
+        path.push_back(start);
+        for(size_t r = 1; r < this->route.size(); r++) {
+            const int from = cellOf(this->route[r - 1]);
+            const int to = cellOf(this->route[r]);
+            if(from == to)
+                continue;
+
+            const int c = this->clusterOf(g, from);
+            if(c != this->clusterOf(g, to)) {
+                path.push_back(to);
+                continue;
+            }
+
+            this->localSearch(g, c, from, to);
+            this->appendLocalPath(g, c, from, to, path);
+        }
+
+        return true;
+    }
+
+    // abstract nodes taken off the open list by the last findPath
+    size_t lastExpanded(void) const { return this->expanded; }
+
+    // clusters plus search scratch, not counting the grid itself
+    size_t memoryUsage(void) const {
+        size_t n = this->clusters.capacity() * sizeof(Cluster);
+        for(auto& cl : this->clusters)
+            n += (cl.entrances.capacity() + cl.dist.capacity()) * sizeof(int);
+
+        n += this->node_cell.capacity() * sizeof(int);
+        n += this->local_links.capacity();
+        n += (this->local_dist.capacity() + this->local_from.capacity() + this->local_queue.capacity()) * sizeof(int);
+        n += this->abs_marks.memoryUsage();
+        n += (this->abs_g.capacity() + this->abs_from.capacity()) * sizeof(int);
+        n += this->open.capacity() * sizeof(OpenNode);
+        n += (this->start_dist.capacity() + this->goal_dist.capacity() + this->route.capacity()) * sizeof(int);
+        return n;
+    }
+};
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+#include "nav_graph.h"
+#include "path_search.h"
+#include "thread_pool.h"
+
+// answers to a batch of path queries, one per query in the order they
+// were asked. all paths share one flat cell buffer, query i is
+// cells[offsets[i] .. offsets[i+1]) and is empty if there was no path
+struct PathBatchResult {
+    std::vector<int> offsets;
+    std::vector<int> cells;
+
+    int count(void) const { return this->offsets.empty() ? 0 : this->offsets.size() - 1; }
+    bool found(int i) const { return this->offsets[i + 1] > this->offsets[i]; }
+    int length(int i) const { return this->offsets[i + 1] - this->offsets[i]; }
+
+    const int* begin(int i) const { return this->cells.data() + this->offsets[i]; }
+    const int* end(int i) const { return this->cells.data() + this->offsets[i + 1]; }
+};
+
+// fans a batch of independent path queries out over a thread pool. the
+// grid is only read, every worker searches with its own PathSearch so
+// nothing is locked while searching. keep one of these around between
+// batches and the scratch space is reused instead of reallocated
+class PathBatch {
+    struct Scratch {
+        PathSearch search;
+        std::vector<int> path;
+        std::vector<int> cells; // every path this worker found in this batch
+    };
+
+    ThreadPool& pool;
+    std::vector<Scratch> scratch; // one per pool worker
+
+    // where each query's cells ended up before they get gathered
+    std::vector<int> found_by;
+    std::vector<int> found_at;
+
+    PathBatch(const PathBatch&) = delete;
+    PathBatch& operator=(const PathBatch&) = delete;
+
+public:
+    PathBatch(ThreadPool& pool) : pool(pool), scratch(pool.size()) {}
+
+    // queries are (start cell, goal cell) pairs on g. mode is a PathMode,
+    // HPA isn't available here and runs as A*. a query with a cell off
+    // the grid or on a wall gets an empty path. g must not change until
+    // this returns
+    void run(
+            const NavGrid& g, const std::vector<std::pair<int,int>>& queries,
+            PathBatchResult& out, int mode = PathMode::ASTAR) {
+
+        const int n = queries.size();
+
+        for(auto& s : this->scratch)
+            s.cells.clear();
+
+        this->found_by.resize(n);
+        this->found_at.resize(n);
+        out.offsets.assign(n + 1, 0);
+
+        this->pool.run(n, [&](int i, int worker) {
+            Scratch& s = this->scratch[worker];
+
+            const int a = queries[i].first;
+            const int b = queries[i].second;
+
+            if(a >= 0 && a < g.cellCount() && b >= 0 && b < g.cellCount() && g.walkable(a) && g.walkable(b))
+                s.search.search(mode, g, a, b, s.path);
+            else
+                s.path.clear();
+
+            this->found_by[i] = worker;
+            this->found_at[i] = s.cells.size();
+            s.cells.insert(s.cells.end(), s.path.begin(), s.path.end());
+
+            // lengths for now, turned into offsets below
+            out.offsets[i + 1] = s.path.size();
+        });
+
+        for(int i = 0; i < n; i++)
+            out.offsets[i + 1] += out.offsets[i];
+
+        out.cells.resize(out.offsets[n]);
+        for(int i = 0; i < n; i++) {
+            const int* src = this->scratch[this->found_by[i]].cells.data() + this->found_at[i];
+            std::copy(src, src + out.length(i), out.cells.begin() + out.offsets[i]);
+        }
+    }
+
+    // scratch of every worker together
+    size_t memoryUsage(void) const {
+        size_t bytes = (this->found_by.capacity() + this->found_at.capacity()) * sizeof(int);
+        for(auto& s : this->scratch)
+            bytes += s.search.memoryUsage() + (s.path.capacity() + s.cells.capacity()) * sizeof(int);
+        return bytes;
+    }
+};
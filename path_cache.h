@@ -0,0 +1,86 @@
+#pragma once
+
+#include <list>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+// least recently used cache of path results. an entry is only good for
+// the map version it was found on, anything older counts as a miss and
+// gets replaced. the oldest entry is recycled once the cache is full so
+// a warm cache doesn't allocate
+class PathCache {
+    struct Entry {
+        uint64_t key;
+        unsigned long version;
+        bool found;
+        std::vector<int> cells;
+    };
+
+    size_t capacity;
+    std::list<Entry> order; // most recently used first
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+
+    unsigned long hit_count;
+    unsigned long miss_count;
+
+    // cell indices stay well under 2^30, mode is a PathMode
+    static uint64_t makeKey(int start, int goal, int mode) {
+        return (uint64_t(start) << 34) | (uint64_t(goal) << 2) | uint64_t(mode & 3); }
+
+public:
+    PathCache(size_t capacity = 256) : capacity(capacity), hit_count(0), miss_count(0) {}
+
+    // the cached result for this query on this map version, NULL if there
+    // isn't one. found says whether there was a path at all
+    const std::vector<int>* find(int start, int goal, int mode, unsigned long version, bool& found) {
+        auto iter = this->index.find(makeKey(start, goal, mode));
+        if(iter == this->index.end() || iter->second->version != version) {
+            this->miss_count++;
+            return NULL;
+        }
+
+        this->order.splice(this->order.begin(), this->order, iter->second);
+        this->hit_count++;
+
+        found = iter->second->found;
+        return &iter->second->cells;
+    }
+
+    void insert(int start, int goal, int mode, unsigned long version, bool found, const std::vector<int>& cells) {
+        if(this->capacity == 0)
+            return;
+
+        const uint64_t key = makeKey(start, goal, mode);
+
+        auto iter = this->index.find(key);
+        if(iter != this->index.end()) {
+            this->order.splice(this->order.begin(), this->order, iter->second);
+        }
+        else if(this->order.size() < this->capacity) {
+            this->order.push_front(Entry());
+            this->index[key] = this->order.begin();
+        }
+        else {
+            // reuse the least recently used entry, cells keeps its capacity
+            this->order.splice(this->order.begin(), this->order, std::prev(this->order.end()));
+            this->index.erase(this->order.front().key);
+            this->index[key] = this->order.begin();
+        }
+
+        Entry& e = this->order.front();
+        e.key = key;
+        e.version = version;
+        e.found = found;
+        e.cells.assign(cells.begin(), cells.end());
+    }
+
+    void clear(void) {
+        this->order.clear();
+        this->index.clear();
+    }
+
+    size_t size(void) const { return this->order.size(); }
+    unsigned long hits(void) const { return this->hit_count; }
+    unsigned long misses(void) const { return this->miss_count; }
+};
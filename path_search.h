@@ -0,0 +1,301 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+
+#include "nav_graph.h"
+#include "visit_stamps.h"
+
+// which search Graph::findPath runs. all of them find shortest paths
+struct PathMode {
+    static const int ASTAR = 0;
+    static const int BFS   = 1;
+    static const int JPS   = 2; // jump point search, only expands turning points
+    static const int HPA   = 3; // hierarchical (nav_hierarchy.h), close to shortest. Graph only
+};
+
+// shortest path searches over a NavGrid. all the per-search state (open
+// list, came-from links, closed set) lives in here and is kept between
+// queries, so a PathSearch that is reused allocates nothing once it has
+// seen the largest grid. one PathSearch per thread, they aren't shared
+class PathSearch {
+    struct OpenNode {
+        int f;
+        int g;
+        int cell;
+    };
+
+    // min-heap on f, ties go to the node furthest from the start which
+    // keeps A* from fanning out across open floor with equal f values
+    struct OpenCompare {
+        bool operator()(const OpenNode& a, const OpenNode& b) const {
+            return a.f != b.f ? a.f > b.f : a.g < b.g; }
+    };
+
+    VisitStamps marks;
+    std::vector<int> came_from;
+    std::vector<int> g_cost;
+    std::vector<OpenNode> open;
+    std::vector<int> queue;
+
+    size_t expanded;
+
+    void prepare(const NavGrid& g) {
+        const size_t n = g.cellCount();
+        this->marks.next(n);
+        this->came_from.resize(n);
+        this->g_cost.resize(n);
+        this->open.clear();
+        this->queue.clear();
+        this->expanded = 0;
+    }
+
+    static int manhattan(const NavGrid& g, int a, int b) {
+        return std::abs(g.cellY(a) - g.cellY(b)) + std::abs(g.cellX(a) - g.cellX(b)); }
+
+    void buildPath(int start, int goal, std::vector<int>& path) const {
+        path.clear();
+        for(int i = goal; i != start; i = this->came_from[i])
+            path.push_back(i);
+        path.push_back(start);
+        std::reverse(path.begin(), path.end());
+    }
+
+    // jps links jump points that share a row or column, fill in every cell
+    // between them
+    void buildJumpPath(const NavGrid& g, int start, int goal, std::vector<int>& path) const {
+        path.clear();
+        for(int i = goal; i != start; ) {
+            const int p = this->came_from[i];
+            const int d = (g.cellY(p) == g.cellY(i)) ? (p > i ? 1 : -1) : (p > i ? g.getWidth() : -g.getWidth());
+            for(; i != p; i += d)
+                path.push_back(i);
+        }
+        path.push_back(start);
+        std::reverse(path.begin(), path.end());
+    }
+
+    // walks from (y, x) in direction (dy, dx) until it hits a wall (-1),
+    // the goal or a cell with a forced neighbor: one a path could only
+    // reach optimally by turning there. vertical scans also stop at any
+    // cell a horizontal scan would find something from
+    static int jump(const NavGrid& g, int y, int x, int dy, int dx, int goal) {
+        for(;;) {
+            y += dy;
+            x += dx;
+
+            if(!g.walkable(y, x))
+                return -1;
+
+            const int i = g.index(y, x);
+            if(i == goal)
+                return i;
+
+            if(dx != 0) {
+                if((g.walkable(y - 1, x) && !g.walkable(y - 1, x - dx)) ||
+                        (g.walkable(y + 1, x) && !g.walkable(y + 1, x - dx)))
+                    return i;
+            }
+            else {
+                if((g.walkable(y, x - 1) && !g.walkable(y - dy, x - 1)) ||
+                        (g.walkable(y, x + 1) && !g.walkable(y - dy, x + 1)))
+                    return i;
+
+                if(jump(g, y, x, 0, 1, goal) >= 0 || jump(g, y, x, 0, -1, goal) >= 0)
+                    return i;
+            }
+        }
+    }
+
+public:
+    PathSearch(void) : expanded(0) {}
+
+    // A* with a manhattan heuristic. on success path holds the cells from
+    // start to goal (both included). path is cleared either way
+    bool astar(const NavGrid& g, int start, int goal, std::vector<int>& path) {
+        path.clear();
+        if(!g.walkable(start) || !g.walkable(goal))
+            return false;
+
+        this->prepare(g);
+
+        OpenCompare cmp;
+
+        this->g_cost[start] = 0;
+        this->came_from[start] = start;
+        this->marks.markOpen(start);
+        this->open.push_back({ manhattan(g, start, goal), 0, start });
+
+        while(!this->open.empty()) {
+            std::pop_heap(this->open.begin(), this->open.end(), cmp);
+            const OpenNode cur = this->open.back();
+            this->open.pop_back();
+
+            // stale entry, the node was reached more cheaply since
+            if(this->marks.isClosed(cur.cell))
+                continue;
+
+            this->marks.markClosed(cur.cell);
+            this->expanded++;
+
+            if(cur.cell == goal) {
+                this->buildPath(start, goal, path);
+                return true;
+            }
+
+            const int ng = cur.g + 1;
+            g.forEachNeighbor(cur.cell, [&](int j) {
+                if(this->marks.isClosed(j))
+                    return;
+                if(this->marks.isOpen(j) && this->g_cost[j] <= ng)
+                    return;
+
+                this->marks.markOpen(j);
+                this->g_cost[j] = ng;
+                this->came_from[j] = cur.cell;
+                this->open.push_back({ ng + manhattan(g, j, goal), ng, j });
+                std::push_heap(this->open.begin(), this->open.end(), cmp);
+            });
+        }
+
+        return false;
+    }
+
+    // breadth first search, same contract as astar(). every edge costs the
+    // same so this is also shortest, it just looks at more of the map
+    bool bfs(const NavGrid& g, int start, int goal, std::vector<int>& path) {
+        path.clear();
+        if(!g.walkable(start) || !g.walkable(goal))
+            return false;
+
+        this->prepare(g);
+
+        this->came_from[start] = start;
+        this->marks.markClosed(start);
+        this->queue.push_back(start);
+
+        for(size_t head = 0; head < this->queue.size(); head++) {
+            const int i = this->queue[head];
+            this->expanded++;
+
+            if(i == goal) {
+                this->buildPath(start, goal, path);
+                return true;
+            }
+
+            g.forEachNeighbor(i, [&](int j) {
+                if(this->marks.isUnseen(j)) {
+                    this->marks.markClosed(j);
+                    this->came_from[j] = i;
+                    this->queue.push_back(j);
+                }
+            });
+        }
+
+        return false;
+    }
+
+    // jump point search for a 4-connected grid where every step costs the
+    // same. same contract and same path lengths as astar(), but straight
+    // runs are scanned without putting every cell on the open list, so
+    // corridors and open rooms expand a handful of nodes instead of all
+    bool jps(const NavGrid& g, int start, int goal, std::vector<int>& path) {
+        path.clear();
+        if(!g.walkable(start) || !g.walkable(goal))
+            return false;
+
+        this->prepare(g);
+
+        OpenCompare cmp;
+
+        this->g_cost[start] = 0;
+        this->came_from[start] = start;
+        this->marks.markOpen(start);
+        this->open.push_back({ manhattan(g, start, goal), 0, start });
+
+        while(!this->open.empty()) {
+            std::pop_heap(this->open.begin(), this->open.end(), cmp);
+            const OpenNode cur = this->open.back();
+            this->open.pop_back();
+
+            if(this->marks.isClosed(cur.cell))
+                continue;
+
+            this->marks.markClosed(cur.cell);
+            this->expanded++;
+
+            if(cur.cell == goal) {
+                this->buildJumpPath(g, start, goal, path);
+                return true;
+            }
+
+            const int y = g.cellY(cur.cell);
+            const int x = g.cellX(cur.cell);
+
+            // direction we arrived in, (0, 0) at the start
+            const int p = this->came_from[cur.cell];
+            const int py = (y > g.cellY(p)) - (y < g.cellY(p));
+            const int px = (x > g.cellX(p)) - (x < g.cellX(p));
+
+            // pruned neighbors: straight on plus both sides. never back
+            int dirs[4][2];
+            int n = 0;
+            if(py == 0 && px == 0) {
+                dirs[n][0] = -1; dirs[n++][1] =  0;
+                dirs[n][0] =  1; dirs[n++][1] =  0;
+                dirs[n][0] =  0; dirs[n++][1] =  1;
+                dirs[n][0] =  0; dirs[n++][1] = -1;
+            }
+            else if(px != 0) {
+                dirs[n][0] =  0; dirs[n++][1] = px;
+                dirs[n][0] = -1; dirs[n++][1] =  0;
+                dirs[n][0] =  1; dirs[n++][1] =  0;
+            }
+            else {
+                dirs[n][0] = py; dirs[n++][1] =  0;
+                dirs[n][0] =  0; dirs[n++][1] = -1;
+                dirs[n][0] =  0; dirs[n++][1] =  1;
+            }
+
+            for(int k = 0; k < n; k++) {
+                const int j = jump(g, y, x, dirs[k][0], dirs[k][1], goal);
+                if(j < 0 || this->marks.isClosed(j))
+                    continue;
+
+                const int ng = cur.g + manhattan(g, cur.cell, j);
+                if(this->marks.isOpen(j) && this->g_cost[j] <= ng)
+                    continue;
+
+                this->marks.markOpen(j);
+                this->g_cost[j] = ng;
+                this->came_from[j] = cur.cell;
+                this->open.push_back({ ng + manhattan(g, j, goal), ng, j });
+                std::push_heap(this->open.begin(), this->open.end(), cmp);
+            }
+        }
+
+        return false;
+    }
+
+    // any of the searches above, mode is a PathMode. HPA needs the
+    // clusters a Graph keeps around, here it falls back to A*
+    bool search(int mode, const NavGrid& g, int start, int goal, std::vector<int>& path) {
+        switch(mode) {
+            case PathMode::BFS: return this->bfs(g, start, goal, path);
+            case PathMode::JPS: return this->jps(g, start, goal, path);
+            default:            return this->astar(g, start, goal, path);
+        }
+    }
+
+    // nodes taken off the open list / queue by the last search
+    size_t lastExpanded(void) const { return this->expanded; }
+
+    // scratch space held between searches
+    size_t memoryUsage(void) const {
+        return this->marks.memoryUsage() +
+            (this->came_from.capacity() + this->g_cost.capacity() + this->queue.capacity()) * sizeof(int) +
+            this->open.capacity() * sizeof(OpenNode);
+    }
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vector>
+#include <cstdlib>
+
+#include "nav_graph.h"
+
+// any-angle smoothing of grid paths. a path from PathSearch steps one
+// tile at a time, so a diagonal run across open floor comes out as a
+// staircase with a waypoint on every step. smoothing keeps only the
+// tiles the path has to turn at: a waypoint is dropped whenever the
+// straight line from the last kept one to the one after it stays on
+// walkable tiles. lines go from tile center to tile center
+
+// whether the straight line between the centers of cells a and b only
+// crosses walkable cells of g. the walk visits every cell the line
+// touches (a supercover DDA), and where it passes exactly through a
+// corner both cells beside that corner have to be walkable, so lines
+// never squeeze diagonally between two barriers
+bool line_of_sight(const NavGrid& g, int a, int b) {
+    int y = g.cellY(a);
+    int x = g.cellX(a);
+    const int dy = g.cellY(b) - y;
+    const int dx = g.cellX(b) - x;
+    const int ny = std::abs(dy);
+    const int nx = std::abs(dx);
+    const int sy = dy < 0 ? -1 : 1;
+    const int sx = dx < 0 ? -1 : 1;
+
+    if(!g.walkable(a))
+        return false;
+
+    for(int iy = 0, ix = 0; iy < ny || ix < nx; ) {
+        // which cell border the line reaches next, compared without
+        // dividing: (2*ix + 1) / nx against (2*iy + 1) / ny
+        const long cross = long(2 * ix + 1) * ny - long(2 * iy + 1) * nx;
+
+        if(cross == 0) {
+            if(!g.walkable(y, x + sx) || !g.walkable(y + sy, x))
+                return false;
+            y += sy; x += sx;
+            iy++; ix++;
+        }
+        else if(cross < 0) {
+            x += sx;
+            ix++;
+        }
+        else {
+            y += sy;
+            iy++;
+        }
+
+        if(!g.walkable(y, x))
+            return false;
+    }
+    return true;
+}
+
+// the waypoints of cells (a connected path, start first) that can't be
+// skipped, into out. start and end are always kept. out can't be cells
+void smooth_path(const NavGrid& g, const std::vector<int>& cells, std::vector<int>& out) {
+    out.clear();
+    if(cells.empty())
+        return;
+
+    out.push_back(cells[0]);
+
+    // greedy string pulling: stay on the last kept waypoint until the
+    // line from it to the next cell is blocked, then keep the cell
+    // before that one
+    for(size_t i = 1; i + 1 < cells.size(); i++) {
+        if(!line_of_sight(g, out.back(), cells[i + 1]))
+            out.push_back(cells[i]);
+    }
+
+    if(cells.size() > 1)
+        out.push_back(cells.back());
+}
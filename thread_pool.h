@@ -0,0 +1,101 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+// fixed set of worker threads that get handed batches of independent
+// work items. threads are started once and reused for every batch so
+// running lots of small batches doesn't pay for thread creation
+class ThreadPool {
+    std::vector<std::thread> workers;
+
+    std::mutex mtx;
+    std::condition_variable cv_work;
+    std::condition_variable cv_done;
+
+    // current batch
+    std::function<void(int, int)> job;
+    int job_count;
+    std::atomic<int> next_item;
+    int busy;             // workers that haven't finished the current batch
+    unsigned generation;  // bumped for every batch so workers see new work
+    bool stopping;
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void workerLoop(int worker) {
+        unsigned seen = 0;
+
+        for(;;) {
+            {
+                std::unique_lock<std::mutex> lock(this->mtx);
+                this->cv_work.wait(lock, [this, seen] {
+                    return this->stopping || this->generation != seen; });
+
+                if(this->stopping)
+                    return;
+                seen = this->generation;
+            }
+
+            for(int i; (i = this->next_item.fetch_add(1)) < this->job_count; )
+                this->job(i, worker);
+
+            std::lock_guard<std::mutex> lock(this->mtx);
+            if(--this->busy == 0)
+                this->cv_done.notify_one();
+        }
+    }
+
+public:
+    // threads <= 0 uses every core
+    ThreadPool(int threads = 0) :
+            job_count(0), next_item(0), busy(0), generation(0), stopping(false) {
+
+        if(threads <= 0)
+            threads = std::thread::hardware_concurrency();
+        if(threads <= 0)
+            threads = 1;
+
+        for(int i = 0; i < threads; i++)
+            this->workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+
+    ~ThreadPool(void) {
+        {
+            std::lock_guard<std::mutex> lock(this->mtx);
+            this->stopping = true;
+        }
+        this->cv_work.notify_all();
+
+        for(auto& t : this->workers)
+            t.join();
+    }
+
+    int size(void) const { return this->workers.size(); }
+
+    // calls fn(item, worker) for every item in [0, count) and returns once
+    // all of them are done. worker is in [0, size()) and is only ever used
+    // by one thread at a time, handy for indexing per-thread scratch space
+    void run(int count, std::function<void(int, int)> fn) {
+        if(count <= 0)
+            return;
+
+        std::unique_lock<std::mutex> lock(this->mtx);
+
+        this->job = fn;
+        this->job_count = count;
+        this->next_item = 0;
+        this->busy = this->workers.size();
+        this->generation++;
+
+        this->cv_work.notify_all();
+        this->cv_done.wait(lock, [this] { return this->busy == 0; });
+
+        this->job = nullptr;
+    }
+};
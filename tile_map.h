@@ -0,0 +1,368 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+
+struct Tile_t {
+    int type;
+
+    static const int DEFAULT     = 0;
+    static const int BARRIER     = 1;
+    static const int SPAWN_POINT = 2;
+};
+
+// map is split into square chunks that only get allocated once
+// something non-default is written into them. a chunk row is exactly
+// one machine word so every tile attribute lives in its own bit-plane
+#define TILE_CHUNK_SHIFT 6
+#define TILE_CHUNK_SIZE  (1 << TILE_CHUNK_SHIFT)
+#define TILE_CHUNK_MASK  (TILE_CHUNK_SIZE - 1)
+
+typedef uint64_t TileWord_t;
+
+static_assert(sizeof(TileWord_t) * 8 == TILE_CHUNK_SIZE, "one word per chunk row");
+
+struct TileChunk {
+    TileWord_t barrier[TILE_CHUNK_SIZE];
+    TileWord_t spawn[TILE_CHUNK_SIZE];
+    TileWord_t tracked[TILE_CHUNK_SIZE]; // scratch for the collision optimizer
+
+    TileChunk(void) {
+        for(int i = 0; i < TILE_CHUNK_SIZE; i++)
+            this->barrier[i] = this->spawn[i] = this->tracked[i] = 0;
+    }
+
+    static TileWord_t bit(int x) {
+        return TileWord_t(1) << (x & TILE_CHUNK_MASK); }
+
+    int get(int y, int x) const {
+        const int r = y & TILE_CHUNK_MASK;
+        if(this->barrier[r] & bit(x)) return Tile_t::BARRIER;
+        if(this->spawn[r] & bit(x))   return Tile_t::SPAWN_POINT;
+        return Tile_t::DEFAULT;
+    }
+
+    void set(int y, int x, int type) {
+        const int r = y & TILE_CHUNK_MASK;
+        this->barrier[r] &= ~bit(x);
+        this->spawn[r]   &= ~bit(x);
+
+        if(type == Tile_t::BARRIER)
+            this->barrier[r] |= bit(x);
+        else if(type == Tile_t::SPAWN_POINT)
+            this->spawn[r] |= bit(x);
+    }
+
+    // number of non-default tiles
+    int used(void) const {
+        int n = 0;
+        for(int i = 0; i < TILE_CHUNK_SIZE; i++)
+            n += __builtin_popcountll(this->barrier[i] | this->spawn[i]);
+        return n;
+    }
+
+    bool empty(void) const {
+        TileWord_t any = 0;
+        for(int i = 0; i < TILE_CHUNK_SIZE; i++)
+            any |= this->barrier[i] | this->spawn[i];
+        return any == 0;
+    }
+};
+
+class TileMap {
+    int width;
+    int height;
+
+    // chunks can be shared with snapshots, anything that writes to a
+    // chunk goes through writableChunk() first
+    std::unordered_map<uint64_t, std::shared_ptr<TileChunk>> chunks;
+
+    TileChunk* findChunk(int y, int x) const {
+        auto iter = this->chunks.find(chunkKey(y >> TILE_CHUNK_SHIFT, x >> TILE_CHUNK_SHIFT));
+        return iter == this->chunks.end() ? NULL : iter->second.get();
+    }
+
+    // copies the chunk first if a snapshot still points at it. the only
+    // other owners are snapshots (which never hand out new references to
+    // this map's chunks) so a count of 1 can't go back up behind our back
+    TileChunk* writableChunk(std::shared_ptr<TileChunk>& c) {
+        if(c.use_count() > 1)
+            c = std::make_shared<TileChunk>(*c);
+        else
+            // use_count() is a relaxed load, pair it with the other owner's
+            // release so its last reads happen before our writes
+            std::atomic_thread_fence(std::memory_order_acquire);
+        return c.get();
+    }
+
+    typedef TileWord_t (TileMap::*WordFn)(int, int) const;
+
+    int runH(int y, int x, WordFn word) const {
+        int len = 0;
+
+        for(;;) {
+            TileWord_t w = (this->*word)(y, x >> TILE_CHUNK_SHIFT) >> (x & TILE_CHUNK_MASK);
+            const int avail = TILE_CHUNK_SIZE - (x & TILE_CHUNK_MASK);
+
+            // ~w is never zero here unless the rest of the word is all set
+            const int run = (~w == 0) ? avail : std::min(__builtin_ctzll(~w), avail);
+
+            len += run;
+            x += run;
+
+            if(run < avail)
+                return len;
+        }
+    }
+
+    int runV(int y, int x, WordFn word) const {
+        const int wx = x >> TILE_CHUNK_SHIFT;
+        const TileWord_t b = TileChunk::bit(x);
+
+        int len = 0;
+        while((this->*word)(y + len, wx) & b)
+            len++;
+
+        return len;
+    }
+
+    bool span(int y, int x, int len, WordFn word) const {
+        while(len > 0) {
+            const int off = x & TILE_CHUNK_MASK;
+            const int n = std::min(len, TILE_CHUNK_SIZE - off);
+            const TileWord_t m = (n == TILE_CHUNK_SIZE) ? ~TileWord_t(0) : (((TileWord_t(1) << n) - 1) << off);
+
+            if(((this->*word)(y, x >> TILE_CHUNK_SHIFT) & m) != m)
+                return false;
+
+            x += n;
+            len -= n;
+        }
+        return true;
+    }
+
+public:
+    TileMap(int width = 25, int height = 25) : width(width), height(height) {}
+
+    // hash key of the chunk at chunk coordinates (cy, cx)
+    static uint64_t chunkKey(int cy, int cx) {
+        return (uint64_t(uint32_t(cy)) << 32) | uint32_t(cx); }
+
+    int getWidth(void) const { return this->width; }
+    int getHeight(void) const { return this->height; }
+
+    bool inBounds(int y, int x) const {
+        return y >= 0 && x >= 0 && y < this->height && x < this->width; }
+
+    // cheap copy of the map that shares every chunk with this one. either
+    // side copies a chunk the first time it writes to it, so the snapshot
+    // can be handed to another thread while editing carries on
+    TileMap snapshot(void) const {
+        TileMap m(this->width, this->height);
+        m.chunks = this->chunks;
+        return m;
+    }
+
+    // drops every chunk and changes the map dimensions
+    void reset(int width, int height) {
+        this->chunks.clear();
+        this->width = width;
+        this->height = height;
+    }
+
+    // out-of-bounds and unallocated tiles read as DEFAULT
+    int get(int y, int x) const {
+        if(!this->inBounds(y, x))
+            return Tile_t::DEFAULT;
+
+        TileChunk* c = this->findChunk(y, x);
+        return c ? c->get(y, x) : Tile_t::DEFAULT;
+    }
+
+    void set(int y, int x, int type) {
+        if(!this->inBounds(y, x))
+            return;
+
+        uint64_t key = chunkKey(y >> TILE_CHUNK_SHIFT, x >> TILE_CHUNK_SHIFT);
+        auto iter = this->chunks.find(key);
+
+        if(iter == this->chunks.end()) {
+            if(type == Tile_t::DEFAULT)
+                return; // nothing to do, empty space stays empty
+
+            iter = this->chunks.insert({ key, std::make_shared<TileChunk>() }).first;
+        }
+
+        // writing what is already there shouldn't cost a copy
+        if(iter->second->get(y, x) == type)
+            return;
+
+        TileChunk* c = this->writableChunk(iter->second);
+        c->set(y, x, type);
+
+        // give the memory back once a chunk is empty again
+        if(type == Tile_t::DEFAULT && c->empty())
+            this->chunks.erase(iter);
+    }
+
+    // the TILE_CHUNK_SIZE tiles of row y starting at x = wx * TILE_CHUNK_SIZE,
+    // bit i is tile x+i. zero for rows/words outside the map
+    TileWord_t barrierWord(int y, int wx) const {
+        TileChunk* c = this->findChunk(y, wx << TILE_CHUNK_SHIFT);
+        return (c && y >= 0 && y < this->height) ? c->barrier[y & TILE_CHUNK_MASK] : 0;
+    }
+
+    TileWord_t spawnWord(int y, int wx) const {
+        TileChunk* c = this->findChunk(y, wx << TILE_CHUNK_SHIFT);
+        return (c && y >= 0 && y < this->height) ? c->spawn[y & TILE_CHUNK_MASK] : 0;
+    }
+
+    TileWord_t trackedWord(int y, int wx) const {
+        TileChunk* c = this->findChunk(y, wx << TILE_CHUNK_SHIFT);
+        return (c && y >= 0 && y < this->height) ? c->tracked[y & TILE_CHUNK_MASK] : 0;
+    }
+
+    // marks tiles [x, x+len) of row y as tracked. the tiles must be barriers
+    void track(int y, int x, int len) {
+        while(len > 0) {
+            const int off = x & TILE_CHUNK_MASK;
+            const int n = std::min(len, TILE_CHUNK_SIZE - off);
+            const TileWord_t m = (n == TILE_CHUNK_SIZE) ? ~TileWord_t(0) : (((TileWord_t(1) << n) - 1) << off);
+
+            auto iter = this->chunks.find(chunkKey(y >> TILE_CHUNK_SHIFT, x >> TILE_CHUNK_SHIFT));
+            this->writableChunk(iter->second)->tracked[y & TILE_CHUNK_MASK] |= m;
+
+            x += n;
+            len -= n;
+        }
+    }
+
+    // track() always copies shared chunks first, so a chunk that is still
+    // shared has nothing tracked and must not be written to
+    void clearTracked(void) {
+        for(auto& c : this->chunks) {
+            if(c.second.use_count() > 1)
+                continue;
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            for(auto& w : c.second->tracked)
+                w = 0;
+        }
+    }
+
+    // length of the run of barriers in row y starting at x
+    int barrierRunH(int y, int x) const {
+        return this->runH(y, x, &TileMap::barrierWord); }
+
+    // true if all of [x, x+len) in row y are barriers
+    bool barrierSpan(int y, int x, int len) const {
+        return this->span(y, x, len, &TileMap::barrierWord); }
+
+    // length of the run of barriers in column x starting at y
+    int barrierRunV(int y, int x) const {
+        return this->runV(y, x, &TileMap::barrierWord); }
+
+    size_t chunkCount(void) const { return this->chunks.size(); }
+
+    size_t memoryUsage(void) const {
+        return this->chunks.size() * sizeof(TileChunk); }
+
+    // number of tiles of the given (non-default) type
+    size_t count(int type) const {
+        size_t n = 0;
+        for(auto& c : this->chunks) {
+            for(int i = 0; i < TILE_CHUNK_SIZE; i++) {
+                if(type == Tile_t::BARRIER)
+                    n += __builtin_popcountll(c.second->barrier[i]);
+                else if(type == Tile_t::SPAWN_POINT)
+                    n += __builtin_popcountll(c.second->spawn[i]);
+            }
+        }
+        return n;
+    }
+
+    // visits allocated chunks in row-major order. f(chunk y, chunk x, TileChunk&)
+    template<typename F>
+    void forEachChunk(F f) const {
+        std::vector<std::pair<uint64_t, TileChunk*>> order;
+        for(auto& c : this->chunks)
+            order.push_back({ c.first, c.second.get() });
+
+        std::sort(order.begin(), order.end(),
+            [](const std::pair<uint64_t, TileChunk*>& a, const std::pair<uint64_t, TileChunk*>& b) {
+                return a.first < b.first; });
+
+        for(auto& c : order)
+            f(int(c.first >> 32), int(uint32_t(c.first)), *c.second);
+    }
+
+    // visits every non-default tile in row-major chunk order. f(y, x, type)
+    template<typename F>
+    void forEachTile(F f) const {
+        this->forEachChunk([&f](int cy, int cx, const TileChunk& c) {
+            for(int r = 0; r < TILE_CHUNK_SIZE; r++) {
+                TileWord_t w = c.barrier[r] | c.spawn[r];
+
+                while(w) {
+                    const int i = __builtin_ctzll(w);
+                    w &= w - 1;
+
+                    const int y = (cy << TILE_CHUNK_SHIFT) + r;
+                    const int x = (cx << TILE_CHUNK_SHIFT) + i;
+                    f(y, x, (c.barrier[r] >> i) & 1 ? Tile_t::BARRIER : Tile_t::SPAWN_POINT);
+                }
+            }
+        });
+    }
+};
+
+// a stack of equally sized layers for multi-storey levels. layer 0 is
+// the ground floor, layer z sits directly on top of layer z-1
+class LayeredTileMap {
+    std::vector<TileMap> layers;
+
+public:
+    LayeredTileMap(int width = 25, int height = 25, int depth = 1) :
+        layers(depth, TileMap(width, height)) {}
+
+    int getWidth(void) const { return this->layers[0].getWidth(); }
+    int getHeight(void) const { return this->layers[0].getHeight(); }
+    int getDepth(void) const { return this->layers.size(); }
+
+    // drops every layer and starts over with depth empty ones
+    void reset(int width, int height, int depth = 1) {
+        this->layers.assign(depth, TileMap(width, height)); }
+
+    TileMap& layer(int z) { return this->layers[z]; }
+    const TileMap& layer(int z) const { return this->layers[z]; }
+
+    // new empty layer on top
+    void pushLayer(void) {
+        this->layers.push_back(TileMap(this->getWidth(), this->getHeight())); }
+
+    // removes the top layer, the ground floor always stays
+    void popLayer(void) {
+        if(this->layers.size() > 1)
+            this->layers.pop_back();
+    }
+
+    // every layer shares its chunks with the snapshot, see TileMap::snapshot
+    LayeredTileMap snapshot(void) const {
+        LayeredTileMap m;
+        m.layers.clear();
+        for(auto& l : this->layers)
+            m.layers.push_back(l.snapshot());
+        return m;
+    }
+
+    size_t count(int type) const {
+        size_t n = 0;
+        for(auto& l : this->layers)
+            n += l.count(type);
+        return n;
+    }
+};
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <SDL/SDL.h>
+#include <map>
+#include <vector>
+
+#include "tile_map.h"
+
+// one step of drawing a tile: fill a rectangle (relative to the top-left
+// of the tile) with a solid color. a tile look is a list of these drawn
+// in order on top of a black cell
+struct TileSpriteFill {
+    int x, y, w, h;
+    Uint8 r, g, b;
+};
+
+// per-tile decorations that get drawn on top of the tile type
+struct TileOverlay {
+    static const int NONE = 0;
+    static const int PATH = 1; // tile is part of an ai path
+};
+
+// pre-rendered surface for every (tile type, overlay) combination so a
+// tile costs one blit instead of a pile of SDL_FillRect calls. new tile
+// types only need a style, the sprites are built from the fill lists
+class TileSpriteCache {
+    int tile_px;
+
+    std::map<int, std::vector<TileSpriteFill>> tile_styles;
+    std::map<int, std::vector<TileSpriteFill>> overlay_styles;
+    std::map<std::pair<int, int>, SDL_Surface*> sprites;
+
+    // format the sprites were built for
+    SDL_PixelFormat built_for;
+    bool built;
+
+    TileSpriteCache(const TileSpriteCache&) = delete;
+    TileSpriteCache& operator=(const TileSpriteCache&) = delete;
+
+    static bool sameFormat(const SDL_PixelFormat& a, const SDL_PixelFormat& b) {
+        return a.BitsPerPixel == b.BitsPerPixel &&
+            a.Rmask == b.Rmask && a.Gmask == b.Gmask && a.Bmask == b.Bmask && a.Amask == b.Amask;
+    }
+
+    void freeSprites(void) {
+        for(auto& s : this->sprites)
+            SDL_FreeSurface(s.second);
+        this->sprites.clear();
+        this->built = false;
+    }
+
+    void draw(SDL_Surface* sprite, const std::vector<TileSpriteFill>& fills) {
+        for(auto& f : fills) {
+            SDL_Rect r;
+            r.x = f.x;
+            r.y = f.y;
+            r.w = f.w;
+            r.h = f.h;
+            SDL_FillRect(sprite, &r, SDL_MapRGB(sprite->format, f.r, f.g, f.b));
+        }
+    }
+
+public:
+    TileSpriteCache(int tile_px) : tile_px(tile_px), built(false) {
+
+        // the look every tile type has had in the editor
+        this->setTileStyle(Tile_t::DEFAULT, {
+            { 2, 2, 20, 20, 80, 80, 80 } });
+
+        this->setTileStyle(Tile_t::BARRIER, {
+            {  2,  2, 20, 20, 220,   0,   0 },
+            {  2,  8, 20,  1, 255, 255, 255 },
+            {  2, 16, 20,  1, 255, 255, 255 },
+            {  6,  8,  1,  8, 255, 255, 255 },
+            { 18,  8,  1,  8, 255, 255, 255 },
+            { 12,  2,  1,  7, 255, 255, 255 },
+            { 12, 16,  1,  7, 255, 255, 255 } });
+
+        this->setTileStyle(Tile_t::SPAWN_POINT, {
+            { 2, 2, 20, 20, 0, 255, 255 } });
+
+        this->setOverlayStyle(TileOverlay::NONE, {});
+        this->setOverlayStyle(TileOverlay::PATH, {
+            { 0, 0, tile_px, tile_px, 0, 0, 0 } });
+    }
+
+    ~TileSpriteCache(void) { this->freeSprites(); }
+
+    // changing a style throws away the sprites, they get rebuilt lazily
+    void setTileStyle(int type, const std::vector<TileSpriteFill>& fills) {
+        this->tile_styles[type] = fills;
+        this->freeSprites();
+    }
+
+    void setOverlayStyle(int overlay, const std::vector<TileSpriteFill>& fills) {
+        this->overlay_styles[overlay] = fills;
+        this->freeSprites();
+    }
+
+    // (re)builds every sprite if the screen format differs from last time
+    void build(SDL_Surface* scr) {
+        if(this->built && sameFormat(this->built_for, *scr->format))
+            return;
+
+        this->freeSprites();
+
+        const SDL_PixelFormat* fmt = scr->format;
+
+        for(auto& t : this->tile_styles) {
+            for(auto& o : this->overlay_styles) {
+                SDL_Surface* sprite = SDL_CreateRGBSurface(
+                    SDL_SWSURFACE, this->tile_px, this->tile_px, fmt->BitsPerPixel,
+                    fmt->Rmask, fmt->Gmask, fmt->Bmask, fmt->Amask);
+
+                SDL_FillRect(sprite, NULL, SDL_MapRGB(sprite->format, 0, 0, 0));
+                this->draw(sprite, t.second);
+                this->draw(sprite, o.second);
+
+                this->sprites[{ t.first, o.first }] = sprite;
+            }
+        }
+
+        this->built_for = *fmt;
+        this->built = true;
+    }
+
+    // draws the tile with its top-left corner at pixel (px, py)
+    void blit(SDL_Surface* scr, int type, int overlay, int px, int py) {
+        this->build(scr);
+
+        auto iter = this->sprites.find({ type, overlay });
+        if(iter == this->sprites.end())
+            return;
+
+        SDL_Rect dst;
+        dst.x = px;
+        dst.y = py;
+        SDL_BlitSurface(iter->second, NULL, scr, &dst);
+    }
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+// open / closed marks for searches that never have to be cleared. every
+// search gets a new epoch: a node is open while its stamp is epoch,
+// closed at epoch + 1 and unseen for anything older. starting a search
+// is bumping a counter instead of sweeping every node, so a short query
+// on a big map costs what it expands and nothing more
+class VisitStamps {
+    std::vector<uint32_t> stamp;
+    uint32_t epoch;
+
+public:
+    VisitStamps(void) : epoch(0) {}
+
+    // starts a new search over nodes [0, n)
+    void next(size_t n) {
+        // new nodes start out older than any epoch
+        if(this->stamp.size() < n)
+            this->stamp.resize(n, 0);
+
+        // a few billion searches later the counter runs out, start over
+        if(this->epoch >= uint32_t(-1) - 2) {
+            std::fill(this->stamp.begin(), this->stamp.end(), 0);
+            this->epoch = 0;
+        }
+
+        this->epoch += 2;
+    }
+
+    size_t memoryUsage(void) const { return this->stamp.capacity() * sizeof(uint32_t); }
+
+    bool isUnseen(int i) const { return this->stamp[i] < this->epoch; }
+    bool isOpen(int i) const { return this->stamp[i] == this->epoch; }
+    bool isClosed(int i) const { return this->stamp[i] == this->epoch + 1; }
+
+    void markOpen(int i) { this->stamp[i] = this->epoch; }
+    void markClosed(int i) { this->stamp[i] = this->epoch + 1; }
+};